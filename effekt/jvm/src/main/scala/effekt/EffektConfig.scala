@@ -88,6 +88,49 @@ class EffektConfig(args: Seq[String]) extends REPLConfig(args.takeWhile(_ != "--
     group = advanced
   )
 
+  val llvmOptLevel: ScallopOption[String] = choice(
+    choices = List("0", "1", "2", "3"),
+    name = "opt-level",
+    descr = "Optimization level for the generated code and the runtime on the llvm backend (defaults to 2)",
+    default = Some("2"),
+    noshort = true,
+    group = advanced
+  )
+
+  val native: ScallopOption[Boolean] = toggle(
+    "native",
+    descrYes = "Optimize for the processor of this machine (-march=native) on the llvm backend",
+    default = Some(false),
+    noshort = true,
+    prefix = "no-",
+    group = advanced
+  )
+
+  val lto: ScallopOption[Boolean] = toggle(
+    "lto",
+    descrYes = "Link the runtime as LLVM IR into the program and optimize them together (requires clang and llvm-link of the same version as opt)",
+    default = Some(false),
+    noshort = true,
+    prefix = "no-",
+    group = advanced
+  )
+
+  val pgoGenerate: ScallopOption[Boolean] = toggle(
+    "pgo-generate",
+    descrYes = "Build an instrumented executable that writes a profile (<out>/<name>-<pid>.profraw) on every run (llvm backend, requires clang)",
+    default = Some(false),
+    noshort = true,
+    prefix = "no-",
+    group = advanced
+  )
+
+  val pgoUse: ScallopOption[File] = opt[File](
+    "pgo-use",
+    descr = "Optimize using a profile written by an executable built with --pgo-generate (.profraw files are merged with llvm-profdata first)",
+    noshort = true,
+    group = advanced
+  )
+
   val preludePath: ScallopOption[List[String]] = opt[List[String]](
     "prelude",
     descr = "Modules to be automatically imported in every file",
@@ -229,6 +272,11 @@ class EffektConfig(args: Seq[String]) extends REPLConfig(args.takeWhile(_ != "--
 
   validateFilesIsDirectory(includePath)
 
+  validateOpt(pgoGenerate, pgoUse) {
+    case (Some(true), Some(_)) => Left("Cannot use --pgo-generate together with --pgo-use")
+    case _ => Right(())
+  }
+
   // force some other configs manually to initialize them when compiling with native-image
   server; output; filenames
 }
@@ -259,6 +259,7 @@ object ChezCallCCRunner extends ChezRunner {
 }
 
 object LLVMRunner extends Runner[String] {
+  import scala.sys.process.{Process, ProcessLogger}
 
   val extension = "ll"
 
@@ -269,6 +270,39 @@ object LLVMRunner extends Runner[String] {
   lazy val gccCmd = discoverExecutable(List("cc", "clang", "gcc"), List("--version"))
   lazy val llcCmd = discoverExecutable(List("llc", "llc-18"), List("--version"))
   lazy val optCmd = discoverExecutable(List("opt", "opt-18"), List("--version"))
+  lazy val clangCmd = discoverExecutable(List("clang", "clang-18"), List("--version"))
+  lazy val llvmLinkCmd = discoverExecutable(List("llvm-link", "llvm-link-18"), List("--version"))
+  lazy val llvmProfdataCmd = discoverExecutable(List("llvm-profdata", "llvm-profdata-18"), List("--version"))
+
+  private val versions = scala.collection.mutable.Map.empty[String, String]
+
+  /**
+   * Output of `<cmd> --version`, or the empty string if it cannot be determined
+   */
+  def versionOf(cmd: String): String =
+    versions.getOrElseUpdate(cmd, try { Process(Seq(cmd, "--version")).!!(ProcessLogger(_ => ())) } catch { case _ => "" })
+
+  /**
+   * Major version of an LLVM tool, as reported by `<cmd> --version` (e.g. "LLVM version 18.1.3")
+   */
+  def majorVersion(cmd: String): Option[String] =
+    """version (\d+)\.""".r.findFirstMatchIn(versionOf(cmd)).map(_.group(1))
+
+  /**
+   * Textual IR is only compatible within one LLVM release, so linking the runtime into the
+   * program requires clang and llvm-link to be of the same version as opt and llc.
+   */
+  lazy val ltoToolchain: Either[String, (String, String)] =
+    (for {
+      clang <- clangCmd.toRight("clang")
+      llvmLink <- llvmLinkCmd.toRight("llvm-link")
+    } yield (clang, llvmLink)) match {
+      case Left(cmd) => Left(s"Cannot find ${cmd}")
+      case Right((clang, llvmLink)) =>
+        val versions = (List(clang, llvmLink) ++ optCmd ++ llcCmd).map { cmd => cmd -> majorVersion(cmd) }
+        if (versions.forall { case (_, v) => v.isDefined && v == versions.head._2 }) Right((clang, llvmLink))
+        else Left(s"LLVM versions differ (${versions.map { case (cmd, v) => s"${cmd} ${v.getOrElse("?")}" }.mkString(", ")})")
+    }
 
   def checkSetup(): Either[String, Unit] =
     gccCmd.getOrElseAborting { return Left("Cannot find gcc. This is required to use the LLVM backend.") }
@@ -301,17 +335,227 @@ object LLVMRunner extends Runner[String] {
         Seq()
     }
 
+  /**
+   * Short hex digest of the contents of `files` and of `args`
+   */
+  def digest(files: Seq[String], args: Seq[String]): String = {
+    val md = java.security.MessageDigest.getInstance("SHA-256")
+    files.foreach { f => md.update(java.nio.file.Files.readAllBytes(java.nio.file.Paths.get(f))) }
+    args.foreach { arg => md.update(arg.getBytes("UTF-8")); md.update(0.toByte) }
+    md.digest().take(8).map("%02x".format(_)).mkString
+  }
+
+  /**
+   * Runs `produce` to create `target`, unless it has already been created from inputs with the same
+   * `hash`, which we remember in `<target>.hash`.
+   */
+  def cached(target: String, hash: String)(produce: => Unit)(using C: Context): Unit = {
+    val hashFile = java.nio.file.Paths.get(target + ".hash")
+    val upToDate = file(target).exists && java.nio.file.Files.exists(hashFile) &&
+      java.nio.file.Files.readString(hashFile) == hash
+    if (!upToDate) {
+      // an interrupted `produce` must not leave a target behind that looks up to date
+      java.nio.file.Files.deleteIfExists(hashFile)
+      produce
+      IO.createFile(hashFile.toString, hash)
+    }
+  }
+
+  /**
+   * Compiles the runtime by running `command` (without `-o`) to `<out>/runtime-<hash>.<extension>`,
+   * unless it already exists, and returns its path.
+   *
+   * The hash covers the sources, the command and the version of the compiler, so runtimes for
+   * different configurations (e.g. debug and release) are kept side by side. The runtime is
+   * written to a fresh temporary file that is only renamed when the compiler succeeded, so an
+   * interrupted build is never reused and concurrent builds do not interfere.
+   */
+  def compileRuntime(out: File, extension: String, sources: Seq[String], command: Seq[String])(using C: Context): String = {
+    val name = s"runtime-${digest(sources, versionOf(command.head) +: command)}.${extension}"
+    val runtimePath = (out / name).unixPath
+    if (!file(runtimePath).exists) {
+      val temporary = java.nio.file.Files.createTempFile(out.toFile.toPath, "runtime-", s".${extension}.tmp")
+      try {
+        exec(command ++ Seq("-o", temporary.toString): _*)
+        java.nio.file.Files.move(temporary, java.nio.file.Paths.get(runtimePath),
+          java.nio.file.StandardCopyOption.ATOMIC_MOVE)
+      } finally {
+        java.nio.file.Files.deleteIfExists(temporary)
+      }
+    }
+    runtimePath
+  }
+
+  /**
+   * clang lowers `struct Pos` parameters and results of the runtime functions following the C ABI,
+   * for example to `(i64, ptr)` and `{ i64, ptr }` on x86-64, while the program declares and calls
+   * them with `%Pos` (see forward-declare-c.ll). After linking, such calls would not match the type
+   * of the callee, and calls with mismatching types are never inlined.
+   *
+   * Therefore, the program calls `<name>.adapter` instead, which has the declared signature, passes
+   * arguments and result through memory and calls `<name>` with the lowered signature. Both calls
+   * disappear when inlining. Functions whose arguments clang passes in memory (`byval`, `sret`)
+   * are left alone.
+   */
+  def adaptToRuntime(program: String, runtime: String): String = {
+    import scala.util.matching.Regex
+    import scala.collection.mutable.ListBuffer
+
+    val tpe = raw"\{[^}]*\}|\[[^\]]*\]|[\w%.]+"
+    val types = raw"(?m)^(%[\w.]+) = type (.+)$$".r.findAllMatchIn(program + "\n" + runtime)
+      .map { m => m.group(1) -> m.group(2).trim }.toMap
+
+    // named types other than structs are aliases
+    def resolve(t: String): String = types.get(t.trim) match {
+      case Some(body) if !body.startsWith("{") => resolve(body)
+      case _ => t.trim
+    }
+
+    // splits a list of types or parameters at the commas that are not nested
+    def split(list: String): List[String] = {
+      var depth = 0
+      val parts = ListBuffer(new StringBuilder)
+      list.foreach {
+        case ',' if depth == 0 => parts += new StringBuilder
+        case c =>
+          if ("{[(".contains(c)) depth += 1
+          if ("}])".contains(c)) depth -= 1
+          parts.last += c
+      }
+      parts.map(_.toString.trim).filter(_.nonEmpty).toList
+    }
+
+    def size(t: String): Option[Int] = resolve(t) match {
+      case "i8" => Some(1)
+      case "i16" => Some(2)
+      case "i32" => Some(4)
+      case "i64" | "ptr" | "double" => Some(8)
+      case "i128" => Some(16)
+      case array if array.startsWith("[") =>
+        raw"\[(\d+) x (.+)\]".r.findFirstMatchIn(array).flatMap { m => size(m.group(2)).map(_ * m.group(1).toInt) }
+      case struct if struct.startsWith("{") =>
+        split(struct.stripPrefix("{").stripSuffix("}")).map(size).foldLeft(Option(0)) { (sum, field) =>
+          sum.zip(field).map(_ + _)
+        }
+      case named => types.get(named).flatMap(size)
+    }
+
+    def firstType(parameter: String): String =
+      raw"^($tpe)".r.findFirstMatchIn(parameter).map(_.group(1)).getOrElse(parameter)
+
+    def adapter(name: String, result: String, parameters: List[String], loweredResult: String, lowered: List[String]): Option[String] = {
+      val code = ListBuffer.empty[String]
+      val arguments = ListBuffer.empty[String]
+      var fresh = 0
+      def temporary(): String = { fresh += 1; s"%t${fresh}" }
+      var remaining = lowered
+      var fits = true
+
+      parameters.zipWithIndex.foreach {
+        case (parameter, index) if remaining.headOption.exists(resolve(_) == resolve(parameter)) =>
+          arguments += s"${remaining.head} %p${index}"
+          remaining = remaining.tail
+        case (parameter, index) =>
+          // store the argument and load the lowered arguments it consists of
+          val memory = temporary()
+          code += s"${memory} = alloca ${parameter}"
+          code += s"store ${parameter} %p${index}, ptr ${memory}"
+          var offset = 0
+          while (remaining.nonEmpty && size(parameter).exists(offset < _)) {
+            val address = temporary()
+            val value = temporary()
+            code += s"${address} = getelementptr i8, ptr ${memory}, i64 ${offset}"
+            code += s"${value} = load ${remaining.head}, ptr ${address}"
+            arguments += s"${remaining.head} ${value}"
+            offset += size(remaining.head).getOrElse(Int.MaxValue / 2)
+            remaining = remaining.tail
+          }
+          fits = fits && size(parameter).contains(offset)
+      }
+      fits = fits && remaining.isEmpty
+
+      val call = s"call ${loweredResult} @${name}(${arguments.mkString(", ")})"
+      if (resolve(result) == "void") {
+        code += call
+        code += "ret void"
+      } else if (resolve(result) == resolve(loweredResult)) {
+        val value = temporary()
+        code += s"${value} = ${call}"
+        code += s"ret ${result} ${value}"
+      } else {
+        val value = temporary()
+        val memory = temporary()
+        val converted = temporary()
+        code += s"${value} = ${call}"
+        code += s"${memory} = alloca ${loweredResult}"
+        code += s"store ${loweredResult} ${value}, ptr ${memory}"
+        code += s"${converted} = load ${result}, ptr ${memory}"
+        code += s"ret ${result} ${converted}"
+        fits = fits && size(result).isDefined && size(result) == size(loweredResult)
+      }
+
+      val signature = parameters.zipWithIndex.map { case (parameter, index) => s"${parameter} %p${index}" }.mkString(", ")
+      Option.when(fits) {
+        s"declare ${loweredResult} @${name}(${lowered.mkString(", ")})\n\n" +
+        s"define private ${result} @${name}.adapter(${signature}) alwaysinline {\n" +
+        code.map("  " + _).mkString("\n") + "\n}\n"
+      }
+    }
+
+    val definitions = raw"(?m)^define ([^@\n]*)@([\w.]+)\((.*)\)[^(){}\n]*\{\s*$$".r.findAllMatchIn(runtime)
+      .map { m => m.group(2) -> (m.group(1), m.group(3)) }.toMap
+
+    val adapters = raw"(?m)^[ \t]*declare (\S+) @([\w.]+)\((.*)\)\s*$$".r.findAllMatchIn(program).toList
+      .distinctBy(_.group(2)).flatMap { declaration =>
+        val name = declaration.group(2)
+        val result = declaration.group(1)
+        val parameters = split(declaration.group(3))
+        definitions.get(name).flatMap { case (prefix, list) =>
+          val loweredResult = raw"($tpe)\s*$$".r.findFirstMatchIn(prefix).map(_.group(1)).getOrElse("void")
+          val loweredParameters = split(list)
+          val lowered = loweredParameters.map(firstType)
+          val matches = resolve(result) == resolve(loweredResult) && parameters.map(resolve) == lowered.map(resolve)
+          val indirect = loweredParameters.exists { p => p.contains("byval") || p.contains("sret") || p.contains("inalloca") }
+          // named types of the runtime are not known to the program
+          val named = (loweredResult :: lowered).exists(_.contains("%"))
+          if (matches || indirect || named) None
+          else adapter(name, result, parameters, loweredResult, lowered).map(name -> _)
+        }
+      }
+
+    val renamed = adapters.foldLeft(program) { case (ir, (name, _)) =>
+      ir.replaceAll(raw"(?m)^[ \t]*declare [^\n]*@${Regex.quote(name)}\([^\n]*$$", "")
+        .replaceAll(raw"@${Regex.quote(name)}(?![\w.$$])", Regex.quoteReplacement(s"@${name}.adapter"))
+    }
+    renamed + adapters.map { case (_, code) => "\n" + code }.mkString
+  }
+
   /**
    * Compile the LLVM source file (`<...>.ll`) to an executable
    *
    * Requires LLVM and GCC to be installed on the machine.
    * Assumes [[path]] has the format "SOMEPATH.ll".
+   *
+   * With `--lto` (and neither debugging nor using valgrind), the C runtime is compiled to
+   * LLVM IR by clang and linked into the program before running `opt`, so that both are
+   * optimized together; calls into the runtime are adapted to the C ABI by [[adaptToRuntime]],
+   * so that they can be inlined. This falls back to compiling the runtime by gcc separately if
+   * clang or llvm-link are missing or do not match the version of opt, see [[ltoToolchain]].
+   *
+   * The compiled runtime and the object file of the program are cached, see [[cached]].
+   *
+   * For profile-guided optimization, build with `--pgo-generate`, run the executable on
+   * representative inputs, and rebuild with `--pgo-use` pointing to the written profile.
+   * Without `--lto`, the profile only optimizes the program: the runtime is compiled by gcc,
+   * which cannot read LLVM profiles.
    */
   override def build(path: String)(using C: Context): Option[String] =
 
     val out = C.config.outputPath()
     val basePath = (out / path.stripSuffix(".ll")).unixPath
     val llPath  = basePath + ".ll"
+    val adaptedPath = basePath + ".adapted.ll"
+    val linkedPath = basePath + ".linked.ll"
     val optPath = basePath + ".opt.ll"
     val objPath = basePath + ".o"
     val linkedLibraries = Seq(
@@ -323,18 +567,86 @@ object LLVMRunner extends Runner[String] {
     val llc = llcCmd.getOrElse(missing("llc"))
     val opt = optCmd.getOrElse(missing("opt"))
 
-    exec(opt, llPath, "-S", "-O2", "-o", optPath)
-    exec(llc, "--relocation-model=pic", optPath, "-filetype=obj", "-o", objPath)
+    val optLevel = s"-O${C.config.llvmOptLevel()}"
+    val cpuArgs = if (C.config.native()) Seq("-march=native") else Seq()
+    val llcCpuArgs = if (C.config.native()) Seq("-mcpu=native") else Seq()
 
     val gccMainFile = (C.config.libPath / ".." / "llvm" / "main.c").unixPath
     val executableFile = basePath
-    var gccArgs = Seq(gcc, gccMainFile, "-o", executableFile, objPath) ++ linkedLibraries
 
-    if (C.config.debug()) gccArgs ++= Seq("-g", "-Wall", "-Wextra", "-Werror")
-    if (C.config.valgrind()) gccArgs ++= Seq("-O0", "-g")
-    else if (C.config.debug()) gccArgs ++= Seq("-fsanitize=address,undefined", "-fstack-protector-all")
+    // Profile-guided optimization happens in opt; instrumented executables need clang to link the profile runtime
+    val (pgoArgs, linker) = C.config.pgoUse.toOption.map(file) match {
+      case _ if C.config.pgoGenerate() =>
+        val clang = clangCmd.getOrElse(missing("clang"))
+        (Seq("--pgo-kind=pgo-instr-gen-pipeline", s"--profile-file=${basePath}-%p.profraw"), Seq(clang, "-fprofile-generate"))
+      case Some(profile) if profile.unixPath.endsWith(".profdata") =>
+        (Seq("--pgo-kind=pgo-instr-use-pipeline", s"--profile-file=${profile.unixPath}"), Seq(gcc))
+      case Some(profile) =>
+        val profdata = llvmProfdataCmd.getOrElse(missing("llvm-profdata"))
+        val profdataPath = basePath + ".profdata"
+        cached(profdataPath, digest(Seq(profile.unixPath), Seq(versionOf(profdata)))) {
+          exec(profdata, "merge", "-o", profdataPath, profile.unixPath)
+        }
+        (Seq("--pgo-kind=pgo-instr-use-pipeline", s"--profile-file=${profdataPath}"), Seq(gcc))
+      case None => (Seq(), Seq(gcc))
+    }
+
+    val lto =
+      if (!C.config.lto() || C.config.debug() || C.config.valgrind()) None
+      else ltoToolchain match {
+        case Right(toolchain) => Some(toolchain)
+        case Left(reason) =>
+          C.warning(s"${reason}; compiling the runtime separately instead of using --lto.")
+          None
+      }
 
-    exec(gccArgs: _*)
+    if (C.config.pgoUse.isSupplied && lto.isEmpty)
+      C.warning("Without --lto, the profile given to --pgo-use only optimizes the program, not the runtime.")
+
+    // The runtime only changes with the toolchain and configuration, so we cache it in the
+    // output directory; the program is rebuilt only if it or the options changed.
+    val runtimeFiles = (C.config.libPath / ".." / "llvm").toFile.listFiles.toSeq
+      .filter(_.getName.endsWith(".c")).map(_.getPath).sorted
+    val toolchainVersions = Seq(versionOf(opt), versionOf(llc))
+    val profileFiles = pgoArgs.collect { case arg if arg.startsWith("--profile-file=") && !C.config.pgoGenerate() => arg.stripPrefix("--profile-file=") }
+
+    lto match {
+      case Some((clang, llvmLink)) =>
+        val includes = libuvArgs.filter(_.startsWith("-I"))
+        val runtimeArgs = Seq(clang, gccMainFile, "-S", "-emit-llvm", optLevel) ++ cpuArgs ++ includes
+        val runtimePath = compileRuntime(out, "ll", runtimeFiles, runtimeArgs)
+
+        val optArgs = Seq(opt, linkedPath, "-S", optLevel, "-o", optPath) ++ pgoArgs
+        val llcArgs = Seq(llc, "--relocation-model=pic", optLevel, optPath, "-filetype=obj", "-o", objPath) ++ llcCpuArgs
+        cached(objPath, digest(Seq(llPath, runtimePath) ++ profileFiles, toolchainVersions ++ optArgs ++ llcArgs)) {
+          val program = java.nio.file.Files.readString(java.nio.file.Paths.get(llPath))
+          val runtime = java.nio.file.Files.readString(java.nio.file.Paths.get(runtimePath))
+          IO.createFile(adaptedPath, adaptToRuntime(program, runtime))
+          exec(llvmLink, adaptedPath, runtimePath, "-S", "-o", linkedPath)
+          exec(optArgs: _*)
+          exec(llcArgs: _*)
+        }
+        exec(linker ++ Seq("-o", executableFile, objPath) ++ linkedLibraries: _*)
+
+      case None =>
+        val optArgs = Seq(opt, llPath, "-S", optLevel, "-o", optPath) ++ pgoArgs
+        val llcArgs = Seq(llc, "--relocation-model=pic", optLevel, optPath, "-filetype=obj", "-o", objPath) ++ llcCpuArgs
+        cached(objPath, digest(Seq(llPath) ++ profileFiles, toolchainVersions ++ optArgs ++ llcArgs)) {
+          exec(optArgs: _*)
+          exec(llcArgs: _*)
+        }
+
+        var gccFlags: Seq[String] = Seq()
+        if (C.config.debug()) gccFlags ++= Seq("-g", "-Wall", "-Wextra", "-Werror")
+        if (C.config.valgrind()) gccFlags ++= Seq("-O0", "-g")
+        else if (C.config.debug()) gccFlags ++= Seq("-fsanitize=address,undefined", "-fstack-protector-all")
+        else gccFlags ++= Seq(optLevel) ++ cpuArgs
+
+        val runtimeArgs = linker ++ Seq("-c", gccMainFile) ++ gccFlags ++ libuvArgs.filter(_.startsWith("-I"))
+        val runtimeObjPath = compileRuntime(out, "o", runtimeFiles, runtimeArgs)
+
+        exec(linker ++ Seq("-o", executableFile, objPath, runtimeObjPath) ++ gccFlags ++ linkedLibraries: _*)
+    }
 
     Some(executableFile)
 }
@@ -23,6 +23,9 @@ trait EffektTests extends munit.FunSuite {
   // Whether to execute using debug mode
   def debug = false
 
+  // Whether to link the runtime into the program before optimizing (llvm only)
+  def lto = false
+
   def output: File = new File(".") / "out" / "tests" / getClass.getName.toLowerCase
 
   // The sources of all testfiles are stored here:
@@ -71,6 +74,7 @@ trait EffektTests extends munit.FunSuite {
     )
     if (valgrind) options = options :+ "--valgrind"
     if (debug) options = options :+ "--debug"
+    if (lto) options = options :+ "--lto"
     if (!optimizations) options = options :+ "--no-optimize"
     val configs = compiler.createConfig(options)
     configs.verify()
@@ -12,6 +12,7 @@ class LLVMTests extends EffektTests {
 
   override def valgrind = sys.env.get("EFFEKT_VALGRIND").nonEmpty
   override def debug = sys.env.get("EFFEKT_DEBUG").nonEmpty
+  override def lto = sys.env.get("EFFEKT_LTO").nonEmpty
 
   override lazy val positives: List[File] = List(
     examplesDir / "llvm",
@@ -24,7 +25,7 @@ class LLVMTests extends EffektTests {
    * and their reason
    */
   lazy val missingFeatures: List[File] = List(
-    // Regex
+    // inspect
     examplesDir / "pos" / "simpleparser.effekt",
 
     // toplevel def and let bindings
@@ -75,6 +76,18 @@ class LLVMTests extends EffektTests {
   )
 
   override lazy val ignored: List[File] = missingFeatures ++ noValgrind(examplesDir)
+
+  // Linking the runtime into the program only pays off if its functions are inlined,
+  // which requires the calls to match their lowered signatures (see LLVMRunner.adaptToRuntime)
+  if (lto && LLVMRunner.ltoToolchain.isRight) {
+    test("runtime functions are inlined with --lto (llvm)") {
+      val input = examplesDir / "llvm" / "lto-inline.effekt"
+      assertNoDiff(run(input, true), IO.read(examplesDir / "llvm" / "lto-inline.check"))
+      val optimized = IO.read(output / "lto_inline.opt.ll")
+      assert("""call [^\n]*@c_bytearray_size\b""".r.findFirstIn(optimized).isEmpty,
+        "c_bytearray_size is still called after optimization")
+    }
+  }
 }
 
 /**
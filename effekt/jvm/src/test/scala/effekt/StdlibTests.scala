@@ -55,6 +55,7 @@ class StdlibLLVMTests extends StdlibTests {
 
   override def valgrind = sys.env.get("EFFEKT_VALGRIND").nonEmpty
   override def debug = sys.env.get("EFFEKT_DEBUG").nonEmpty
+  override def lto = sys.env.get("EFFEKT_LTO").nonEmpty
 
   override def withoutOptimizations: List[File] = List(
     examplesDir / "stdlib" / "acme.effekt",
@@ -66,6 +67,7 @@ class StdlibLLVMTests extends StdlibTests {
 
     // Wrong codegen for negative types, see #801
     examplesDir / "stdlib" / "json.effekt",
+    examplesDir / "stdlib" / "json_bytes.effekt",
     examplesDir / "stdlib" / "buffer.effekt",
   )
 }
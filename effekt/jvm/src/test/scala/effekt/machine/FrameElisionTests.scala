@@ -0,0 +1,71 @@
+package effekt.machine
+
+class FrameElisionTests extends munit.FunSuite {
+
+  def int(name: String) = Variable(name, Type.Int())
+
+  val n = int("n")
+  val f = Label("f", List(n))
+
+  def pushedFrames(statement: Statement): Int = statement match {
+    case PushFrame(frame, rest) => 1 + pushedFrames(frame.body) + pushedFrames(rest)
+    case Switch(_, clauses, default) => (clauses.map(_._2) ++ default).map { c => pushedFrames(c.body) }.sum
+    case Substitute(_, rest) => pushedFrames(rest)
+    case ForeignCall(_, _, _, rest) => pushedFrames(rest)
+    case LiteralInt(_, _, rest) => pushedFrames(rest)
+    case _ => 0
+  }
+
+  // val a = { val b = f(n); b * 2 }; a + 1
+  def nested(outerFree: List[Variable] = Nil): Statement = {
+    val (a, b, one, two, sum, product) = (int("a"), int("b"), int("one"), int("two"), int("sum"), int("product"))
+    val outer = Clause(List(a), LiteralInt(one, 1, ForeignCall(sum, "infixAdd", a :: one :: outerFree, Return(List(sum)))))
+    val inner = Clause(List(b), LiteralInt(two, 2, ForeignCall(product, "infixMul", List(b, two), Return(List(product)))))
+    PushFrame(outer, PushFrame(inner, Jump(f)))
+  }
+
+  test("Frames that only return their parameters are removed") {
+    val x = int("x")
+    val input = PushFrame(Clause(List(x), Return(List(x))), Jump(f))
+    assertEquals(FrameElision.transform(input), Jump(f))
+  }
+
+  test("Frames that return something else are kept") {
+    val (x, y) = (int("x"), int("y"))
+    val input = PushFrame(Clause(List(x, y), Return(List(y, x))), Jump(f))
+    assertEquals(FrameElision.transform(input), input)
+  }
+
+  test("Consecutive frames are fused into one") {
+    val input = nested()
+    assertEquals(pushedFrames(input), 2)
+    val output = FrameElision.transform(input)
+    assertEquals(pushedFrames(output), 1)
+
+    val product = int("product")
+    output match {
+      case PushFrame(Clause(List(b), LiteralInt(_, 2L, ForeignCall(`product`, "infixMul", _,
+             Substitute(List((a, `product`)), LiteralInt(_, 1L, ForeignCall(_, "infixAdd", _, Return(_))))))), Jump(`f`)) =>
+        assertEquals(b, int("b"))
+        assertEquals(a, int("a"))
+      case other => fail(s"Unexpected result of fusion: ${other}")
+    }
+  }
+
+  test("Frames that share free variables are not fused") {
+    val input = nested(List(n)) match {
+      case PushFrame(outer, PushFrame(Clause(parameters, body), rest)) =>
+        PushFrame(outer, PushFrame(Clause(parameters, ForeignCall(int("c"), "println", List(n), body)), rest))
+      case other => other
+    }
+    assertEquals(pushedFrames(FrameElision.transform(input)), 2)
+  }
+
+  test("Frames are not fused if the inner frame does not return directly") {
+    val (a, b, c) = (int("a"), int("b"), int("c"))
+    val outer = Clause(List(a), ForeignCall(c, "infixAdd", List(a), Return(List(c))))
+    val inner = Clause(List(b), Jump(Label("g", List(b))))
+    val input = PushFrame(outer, PushFrame(inner, Jump(f)))
+    assertEquals(FrameElision.transform(input), input)
+  }
+}
@@ -39,6 +39,13 @@ class LLVM extends Compiler[String] {
   // The Compilation Pipeline
   // ------------------------
   // Source => Core => Machine => LLVM
+  //
+  // We compile whole programs: `Aggregate` merges all modules, so that the optimizer can inline and
+  // drop unused definitions across modules and `PolymorphismBoxing` sees every use. Compiling modules
+  // separately would need stable names for everything a module defines. Erasers and sharers are
+  // already named after the types they handle (see `Transformer.helperName`), but labels and vtables
+  // are still numbered per program, and boxed polymorphic definitions need a calling convention.
+  // Rebuilding unchanged programs is avoided by the caching in `LLVMRunner.build` instead.
   lazy val Compile = allToCore(Core) andThen Aggregate andThen core.PolymorphismBoxing andThen optimizer.Optimizer andThen Machine map {
     case (mod, main, prog) => (mod, llvm.Transformer.transform(prog))
   }
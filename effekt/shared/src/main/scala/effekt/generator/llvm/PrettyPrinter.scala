@@ -36,6 +36,14 @@ define ${show(callingConvention)} ${show(returnType)} ${globalName(name)}(${comm
 
     case GlobalConstant(name, initializer) =>
       s"@$name = private constant ${show(initializer)}"
+
+    case GlobalByteArray(name, bytes) =>
+      val escaped = bytes.map(b => "\\" + f"$b%02x").mkString;
+      val contents = s"[${bytes.length} x i8]"
+      s"${globalName(name)} = private constant { %ReferenceCount, %Eraser, $contents } { %ReferenceCount -1, %Eraser @c_bytearray_erase_noop, $contents c\"$escaped\" }"
+
+    case GlobalObject(name, eraser, environment) =>
+      s"${globalName(name)} = private constant { %ReferenceCount, %Eraser, ${show(environment.tpe)} } { %ReferenceCount -1, ${show(eraser)}, ${show(environment)} }"
   }
 
   def show(callingConvention: CallingConvention): LLVMString = callingConvention match {
@@ -131,6 +139,9 @@ ${indentedLines(instructions.map(show).mkString("\n"))}
     case ConstantNull(tpe)                  => s"${show(tpe)} null"
     case ConstantArray(memberType, members) => s"[${members.length} x ${show(memberType)}] [${commaSeparated(members.map(show))}]"
     case ConstantInteger8(b)                => s"i8 $b"
+    // environments are packed structures
+    case ConstantStruct(tpe: StructureType, members) => s"${show(tpe)} <{${commaSeparated(members.map(show))}}>"
+    case ConstantStruct(tpe, members)       => s"${show(tpe)} {${commaSeparated(members.map(show))}}"
   }
 
   def show(tpe: Type): LLVMString = tpe match {
@@ -96,12 +96,12 @@ object Transformer {
         val temporaryName = freshName(variable.name + "_temporary")
         emit(InsertValue(temporaryName, ConstantAggregateZero(positiveType), ConstantInt(tag), 0))
         emit(InsertValue(variable.name, LocalReference(positiveType, temporaryName), fields, 1))
+        if (isConstant(fields)) defineConstant(variable.name, ConstantStruct(positiveType, List(ConstantInt(tag), fields)))
 
         eraseValues(List(variable), freeVariables(rest))
         transform(rest)
 
       case machine.Switch(value, clauses, default) =>
-        emit(Comment(s"switch ${value.name}, ${clauses.length} clauses"))
         val freeInClauses = clauses.flatMap(freeVariables).toSet ++ default.map(freeVariables).getOrElse(Set.empty)
         shareValues(List(value), freeInClauses)
 
@@ -116,7 +116,7 @@ object Transformer {
           BC.stack = stack
 
           consumeObject(LocalReference(objectType, objectName), clause.parameters, freeVariables(clause.body));
-          eraseValues(freeInClauses.toList, freeVariables(clause));
+          eraseValuesShared(freeInClauses.toList, freeVariables(clause));
           if (isDefault) eraseValue(value)
 
           val terminator = transform(clause.body);
@@ -129,6 +129,8 @@ object Transformer {
           label
         }
 
+        val blocksBefore = FC.basicBlocks.size
+
         val defaultLabel = default match {
           case Some(clause) => labelClause(clause, isDefault = true)
           case None =>
@@ -141,6 +143,11 @@ object Transformer {
           case (tag, clause) => (tag, labelClause(clause, isDefault = false))
         }
 
+        // the size of the lowered switch, including nested blocks, to keep track of code bloat
+        val blocks = FC.basicBlocks.drop(blocksBefore)
+        val size = blocks.map { block => block.instructions.count { case Comment(_) => false; case _ => true } + 1 }.sum
+        emit(Comment(s"switch ${value.name}, ${clauses.length} clauses, ${blocks.size} blocks, ${size} instructions"))
+
         Switch(LocalReference(IntegerType64(), tagName), defaultLabel, labels)
 
       case machine.New(variable, clauses, rest) =>
@@ -161,11 +168,13 @@ object Transformer {
 
         val vtableName = freshName("vtable")
         emit(GlobalConstant(vtableName, ConstantArray(methodType, clauseNames)))
+        FC.knownClauses = FC.knownClauses + (variable.name -> clauseNames)
 
         val vtable = produceObject("closure", closureEnvironment, freeVariables(rest));
         val temporaryName = freshName("vtable_temporary");
         emit(InsertValue(temporaryName, ConstantAggregateZero(negativeType), ConstantGlobal(vtableName), 0));
         emit(InsertValue(variable.name, LocalReference(negativeType, temporaryName), vtable, 1));
+        if (isConstant(vtable)) defineConstant(variable.name, ConstantStruct(negativeType, List(ConstantGlobal(vtableName), vtable)))
 
         eraseValues(List(variable), freeVariables(rest));
         transform(rest)
@@ -174,17 +183,23 @@ object Transformer {
         emit(Comment(s"invoke ${value.name}, tag ${tag}, ${values.length} values"))
         shareValues(value :: values, Set());
 
-        val vtableName = freshName("vtable");
         val objectName = freshName("closure");
-        val pointerName = freshName("functionPointer_pointer");
-        val functionName = freshName("functionPointer");
         val arguments = values.map(transform)
 
-        emit(ExtractValue(vtableName, transform(value), 0));
         emit(ExtractValue(objectName, transform(value), 1));
-        emit(GetElementPtr(pointerName, methodType, LocalReference(PointerType(), vtableName), List(tag)))
-        emit(Load(functionName, methodType, LocalReference(PointerType(), pointerName), VTable))
-        emit(callLabel(LocalReference(methodType, functionName), LocalReference(objectType, objectName) +: arguments))
+        FC.knownClauses.get(substitute(value).name) match {
+          // the object was created in this function, so we call the clause directly
+          case Some(clauses) =>
+            emit(callLabel(clauses(tag), LocalReference(objectType, objectName) +: arguments))
+          case None =>
+            val vtableName = freshName("vtable");
+            val pointerName = freshName("functionPointer_pointer");
+            val functionName = freshName("functionPointer");
+            emit(ExtractValue(vtableName, transform(value), 0));
+            emit(GetElementPtr(pointerName, methodType, LocalReference(PointerType(), vtableName), List(tag)))
+            emit(Load(functionName, methodType, LocalReference(PointerType(), pointerName), VTable))
+            emit(callLabel(LocalReference(methodType, functionName), LocalReference(objectType, objectName) +: arguments))
+        }
         RetVoid()
 
       case machine.Var(ref @ machine.Variable(name, machine.Type.Reference(tpe)), init, retType, rest) =>
@@ -207,6 +222,7 @@ object Transformer {
         val eraser = getEraser(environment, StackFrameEraser)
 
         emit(Call(name, Ccc(), referenceType, newReference, List(getStack())))
+        FC.localReferences = FC.localReferences + name
 
         shareValues(environment, freeVariables(rest));
         pushFrameOnto(getStack(), environment, returnAddressName, sharer, eraser);
@@ -218,25 +234,17 @@ object Transformer {
       case machine.LoadVar(name, ref, rest) =>
         emit(Comment(s"loadvar ${name.name}, reference ${ref.name}"))
 
-        val ptr = freshName(name.name + "_pointer");
-        val ptrRef = LocalReference(PointerType(), ptr)
-        emit(Call(ptr, Ccc(), PointerType(), getVarPointer, List(transform(ref), getStack())))
-
-        // TODO why do we need this?
-        val oldVal = machine.Variable(freshName(ref.name + "_old"), name.tpe)
-        emit(Load(oldVal.name, transform(oldVal.tpe), ptrRef, StackPointer))
-        shareValue(oldVal)
+        val ptrRef = varPointer(ref, name.name + "_pointer")
 
+        // the variable keeps its value, so we only share the copy we use
         emit(Load(name.name, transform(name.tpe), ptrRef, StackPointer))
-        eraseValues(List(name), freeVariables(rest))
+        shareValues(List(name), freeVariables(rest))
         transform(rest)
 
       case machine.StoreVar(ref, value, rest) =>
         emit(Comment(s"storevar ${ref.name}, value ${value.name}"))
 
-        val ptr = freshName(ref.name + "pointer");
-        val ptrRef = LocalReference(PointerType(), ptr)
-        emit(Call(ptr, Ccc(), PointerType(), getVarPointer, List(transform(ref), getStack())))
+        val ptrRef = varPointer(ref, ref.name + "pointer")
 
         val oldVal = machine.Variable(freshName(ref.name + "_old"), value.tpe)
         emit(Load(oldVal.name, transform(oldVal.tpe), ptrRef, StackPointer))
@@ -284,6 +292,7 @@ object Transformer {
         val newStack = LocalReference(stackType, freshName("stack"))
         emit(Call(newStack.name, Ccc(), stackType, reset, List(getStack())));
         setStack(newStack)
+        FC.localReferences = Set()
 
         emit(Call(prompt.name, Ccc(), promptType, currentPrompt, List(getStack())))
 
@@ -319,6 +328,7 @@ object Transformer {
         val newStackName = freshName("stack");
         emit(Call(newStackName, Ccc(), stackType, resume, List(transform(value), getStack())));
         setStack(LocalReference(stackType, newStackName));
+        FC.localReferences = Set()
         transform(rest)
 
       case machine.Shift(variable, prompt, rest) =>
@@ -331,6 +341,7 @@ object Transformer {
         val newStack = LocalReference(stackType, freshName("stack"));
         emit(ExtractValue(newStack.name, pair, 1))
         setStack(newStack);
+        FC.localReferences = Set()
 
         eraseValues(List(variable), freeVariables(rest));
         transform(rest)
@@ -338,21 +349,23 @@ object Transformer {
       case machine.LiteralInt(machine.Variable(name, _), n, rest) =>
         emit(Comment(s"literalInt $name, n=$n"))
         emit(Add(name, ConstantInt(n), ConstantInt(0)));
+        defineConstant(name, ConstantInt(n))
         transform(rest)
 
       case machine.LiteralDouble(machine.Variable(name, _), x, rest) =>
         emit(Comment(s"literalDouble $name, x=$x"))
         emit(FAdd(name, ConstantDouble(x), ConstantDouble(0)));
+        defineConstant(name, ConstantDouble(x))
         transform(rest)
 
       case machine.LiteralUTF8String(v@machine.Variable(bind, _), utf8, rest) =>
         emit(Comment(s"literalUTF8String $bind, ${utf8.length} bytes"))
-        emit(GlobalConstant(s"$bind.lit", ConstantArray(IntegerType8(), utf8.map { b => ConstantInteger8(b) }.toList)))
+        emit(GlobalByteArray(s"$bind.lit", utf8))
 
-        val res = positiveType
-        val args = List(ConstantInt(utf8.size), ConstantGlobal(s"$bind.lit"))
-        val argsT = List(IntegerType64(), PointerType())
-        emit(Call(bind, Ccc(), res, ConstantGlobal("c_bytearray_construct"), args))
+        val temporaryName = freshName(bind + "_temporary")
+        emit(InsertValue(temporaryName, ConstantAggregateZero(positiveType), ConstantInt(utf8.size), 0))
+        emit(InsertValue(bind, LocalReference(positiveType, temporaryName), ConstantGlobal(s"$bind.lit"), 1))
+        defineConstant(bind, ConstantStruct(positiveType, List(ConstantInt(utf8.size), ConstantGlobal(s"$bind.lit"))))
 
         eraseValues(List(v), freeVariables(rest));
         transform(rest)
@@ -486,7 +499,7 @@ object Transformer {
     C.erasers.getOrElseUpdate((types, kind), {
       kind match {
         case ObjectEraser =>
-          val eraser = ConstantGlobal(freshName("eraser"));
+          val eraser = ConstantGlobal(helperName(s"eraser_${kind}", types));
           defineFunction(eraser.name, List(Parameter(environmentType, "environment"))) {
             emit(Comment(s"${kind} eraser, ${freshEnvironment.length} free variables"))
 
@@ -497,7 +510,7 @@ object Transformer {
           };
           eraser
         case StackEraser | StackFrameEraser =>
-          val eraser = ConstantGlobal(freshName("eraser"));
+          val eraser = ConstantGlobal(helperName(s"eraser_${kind}", types));
           defineFunction(eraser.name, List(Parameter(stackPointerType, "stackPointer"))) {
             emit(Comment(s"${kind} eraser, ${freshEnvironment.length} free variables"))
 
@@ -522,7 +535,7 @@ object Transformer {
     };
 
     C.sharers.getOrElseUpdate((types, kind), {
-      val sharer = ConstantGlobal(freshName("sharer"));
+      val sharer = ConstantGlobal(helperName(s"sharer_${kind}", types));
       defineFunction(sharer.name, List(Parameter(stackPointerType, "stackPointer"))) {
         emit(Comment(s"${kind} sharer, ${freshEnvironment.length} free variables"))
 
@@ -541,8 +554,15 @@ object Transformer {
   }
 
   def produceObject(role: String, environment: machine.Environment, freeInBody: Set[machine.Variable])(using ModuleContext, FunctionContext, BlockContext): Operand = {
+    val constants = environment.map(constantValue)
     if (environment.isEmpty) {
       ConstantNull(objectType)
+    } else if (constants.forall(_.isDefined)) {
+      // all values are immortal or unboxed, so we allocate the object statically and need not share them
+      val objectName = freshName(role + "_static");
+      val eraser = getEraser(environment, ObjectEraser)
+      emit(GlobalObject(objectName, eraser, ConstantStruct(environmentType(environment), constants.flatten)))
+      ConstantGlobal(objectName)
     } else {
       val objectReference = LocalReference(objectType, freshName(role));
       val environmentReference = LocalReference(environmentType, freshName("environment"));
@@ -561,10 +581,12 @@ object Transformer {
     if (environment.isEmpty) {
       ()
     } else {
+      // we only unpack the fields we use, the others are erased together with the object
+      val used = environment.filter { value => freeInBody.map(substitute).contains(substitute(value)) }
       val environmentReference = LocalReference(environmentType, freshName("environment"));
       emit(Call(environmentReference.name, Ccc(), environmentType, objectEnvironment, List(`object`)));
-      loadEnvironment(environmentReference, environment, Object);
-      shareValues(environment, freeInBody);
+      loadFieldsAt(environmentReference, environment, used.toSet, Object);
+      shareValues(used, freeInBody);
       emit(Call("_", Ccc(), VoidType(), eraseObject, List(`object`)));
     }
   }
@@ -632,6 +654,17 @@ object Transformer {
     }
   }
 
+  def loadFieldsAt(pointer: Operand, environment: machine.Environment, fields: Set[machine.Variable], alias: AliasInfo)(using ModuleContext, FunctionContext, BlockContext): Unit = {
+    val `type` = environmentType(environment)
+    environment.zipWithIndex.foreach {
+      case (variable @ machine.Variable(name, tpe), i) if fields.contains(variable) =>
+        val field = LocalReference(PointerType(), freshName(name + "_pointer"));
+        emit(GetElementPtr(field.name, `type`, pointer, List(0, i)));
+        emit(Load(name, transform(tpe), field, alias))
+      case _ => ()
+    }
+  }
+
   def shareValues(values: machine.Environment, freeInBody: Set[machine.Variable])(using FunctionContext, BlockContext): Unit = {
     def loop(values: machine.Environment): Unit = {
       values match {
@@ -656,8 +689,60 @@ object Transformer {
       if !freeInBody.map(substitute).contains(substitute(value)) then eraseValue(value)
     }
 
+  /**
+   * Like [[eraseValues]], but several values are erased by a call to a function that is
+   * shared by all places that erase values of the same types.
+   */
+  def eraseValuesShared(environment: machine.Environment, freeInBody: Set[machine.Variable])(using ModuleContext, FunctionContext, BlockContext): Unit = {
+    val erased = environment.filter { value =>
+      !freeInBody.map(substitute).contains(substitute(value)) && constantValue(value).isEmpty && isBoxed(value.tpe)
+    }
+    if (erased.size <= 1) {
+      erased.foreach(eraseValue)
+    } else {
+      emit(Call("_", Ccc(), VoidType(), getValuesEraser(erased.map(_.tpe)), erased.map(transform)))
+    }
+  }
+
+  def getValuesEraser(types: List[machine.Type])(using C: ModuleContext): Operand =
+    C.valuesErasers.getOrElseUpdate(types, {
+      val eraser = ConstantGlobal(helperName("eraseValues", types));
+      val values = types.map { tpe => machine.Variable(freshName("value"), tpe) }
+      defineFunction(eraser.name, values.map { case machine.Variable(name, tpe) => Parameter(transform(tpe), name) }) {
+        emit(Comment(s"values eraser, ${values.length} values"))
+        eraseValues(values, Set());
+        RetVoid()
+      };
+      eraser
+    })
+
+  /**
+   * Name of a helper function that only depends on its kind and on the given types, like
+   * `eraser_StackFrameEraser_Pos_Int`. Unlike fresh names, it is the same in every program
+   * that needs the helper, which is a first step towards compiling modules separately.
+   */
+  def helperName(kind: String, types: List[machine.Type]): String =
+    (kind :: types.map(typeName)).mkString("_")
+
+  def typeName(tpe: machine.Type): String = tpe match {
+    case machine.Positive()          => "Pos"
+    case machine.Negative()          => "Neg"
+    case machine.Type.Prompt()       => "Prompt"
+    case machine.Type.Stack()        => "Stack"
+    case machine.Type.Int()          => "Int"
+    case machine.Type.Byte()         => "Byte"
+    case machine.Type.Double()       => "Double"
+    case machine.Type.Reference(tpe) => s"Ref${typeName(tpe)}"
+  }
+
+  def isBoxed(tpe: machine.Type): Boolean = tpe match {
+    case machine.Positive() | machine.Negative() | machine.Type.Stack() => true
+    case _ => false
+  }
+
   def shareValue(value: machine.Variable)(using FunctionContext, BlockContext): Unit = {
-    Option(value.tpe).collect {
+    // constants are unboxed or immortal
+    Option(value.tpe).filter { _ => constantValue(value).isEmpty }.collect {
       case machine.Positive()    => Call("_", Ccc(), VoidType(), sharePositive, List(transform(value)))
       case machine.Negative()    => Call("_", Ccc(), VoidType(), shareNegative, List(transform(value)))
       case machine.Type.Stack()  => Call("_", Ccc(), VoidType(), shareResumption, List(transform(value)))
@@ -665,13 +750,21 @@ object Transformer {
   }
 
   def eraseValue(value: machine.Variable)(using FunctionContext, BlockContext): Unit = {
-    Option(value.tpe).collect {
+    // constants are unboxed or immortal
+    Option(value.tpe).filter { _ => constantValue(value).isEmpty }.collect {
       case machine.Positive()    => Call("_", Ccc(), VoidType(), erasePositive, List(transform(value)))
       case machine.Negative()    => Call("_", Ccc(), VoidType(), eraseNegative, List(transform(value)))
       case machine.Type.Stack()  => Call("_", Ccc(), VoidType(), eraseResumption, List(transform(value)))
     }.map(emit)
   }
 
+  def varPointer(ref: machine.Variable, name: String)(using ModuleContext, FunctionContext, BlockContext): Operand = {
+    val pointer = LocalReference(PointerType(), freshName(name))
+    val getPointer = if (FC.localReferences.contains(substitute(ref).name)) getLocalVarPointer else getVarPointer
+    emit(Call(pointer.name, Ccc(), PointerType(), getPointer, List(transform(ref), getStack())))
+    pointer
+  }
+
   def popReturnAddressFrom(stack: Operand, returnAddressName: String)(using ModuleContext, FunctionContext, BlockContext): Unit = {
 
     val stackPointer = LocalReference(stackPointerType, freshName("stackPointer"));
@@ -703,6 +796,7 @@ object Transformer {
 
   val newReference = ConstantGlobal("newReference")
   val getVarPointer = ConstantGlobal("getVarPointer")
+  val getLocalVarPointer = ConstantGlobal("getLocalVarPointer")
 
   val reset = ConstantGlobal("reset");
   val resume = ConstantGlobal("resume");
@@ -722,6 +816,7 @@ object Transformer {
     var definitions: List[Definition] = List();
     val erasers = mutable.HashMap[(List[machine.Type], EraserKind), Operand]();
     val sharers = mutable.HashMap[(List[machine.Type], SharerKind), Operand]();
+    val valuesErasers = mutable.HashMap[List[machine.Type], Operand]();
   }
 
   def emit(definition: Definition)(using C: ModuleContext) =
@@ -734,6 +829,12 @@ object Transformer {
 
   class FunctionContext() {
     var substitution: Map[machine.Variable, machine.Variable] = Map();
+    // variables bound to compile-time constants, which are either unboxed or immortal
+    var constants: Map[String, Operand] = Map();
+    // references allocated by `Var` on the current stack, which we can access without going through their prompt
+    var localReferences: Set[String] = Set();
+    // clauses of the objects created by `New` in this function, indexed by tag
+    var knownClauses: Map[String, List[Operand]] = Map();
     var basicBlocks: List[BasicBlock] = List();
   }
 
@@ -751,6 +852,17 @@ object Transformer {
   def substitute(value: machine.Variable)(using C: FunctionContext): machine.Variable =
     C.substitution.toMap.getOrElse(value, value)
 
+  def defineConstant(name: String, value: Operand)(using C: FunctionContext): Unit =
+    C.constants = C.constants + (name -> value)
+
+  def constantValue(variable: machine.Variable)(using C: FunctionContext): Option[Operand] =
+    C.constants.get(substitute(variable).name)
+
+  def isConstant(operand: Operand): Boolean = operand match {
+    case ConstantNull(_) | ConstantGlobal(_) => true
+    case _ => false
+  }
+
   class BlockContext() {
     var stack: Operand = LocalReference(stackType, "stack");
     var instructions: List[Instruction] = List();
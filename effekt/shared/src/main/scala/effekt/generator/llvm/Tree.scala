@@ -11,6 +11,8 @@ enum Definition {
   case VerbatimFunction(callingConvention: CallingConvention, returnType: Type, name: String, parameters: List[Parameter], body: String)
   case Verbatim(content: String)
   case GlobalConstant(name: String, initializer: Operand) // initializer should be constant
+  case GlobalByteArray(name: String, bytes: Array[Byte]) // immortal bytearray object, see rts.ll
+  case GlobalObject(name: String, eraser: Operand, environment: ConstantStruct) // immortal heap object, see rts.ll
 }
 export Definition.*
 
@@ -90,6 +92,7 @@ object Operand {
   case class ConstantNull(tpe: Type) extends Operand
   case class ConstantArray(memberType: Type, members: List[Operand]) extends Operand // members should be homogeneous
   case class ConstantInteger8(b: Byte) extends Operand
+  case class ConstantStruct(tpe: Type, members: List[Operand]) extends Operand // members should be constant
 }
 export Operand.*
 
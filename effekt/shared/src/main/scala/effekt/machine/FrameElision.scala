@@ -0,0 +1,124 @@
+package effekt
+package machine
+
+import effekt.machine.analysis.*
+
+/**
+ * Removes stack frames that do not do any work and merges frames that are pushed directly
+ * on top of each other.
+ *
+ *   push { (x, y) => return x, y }; s    ~>    s
+ *
+ * A frame that only returns its parameters, in order, is the identity and pushing it
+ * would only cost a return through an additional return address.
+ *
+ *   push { (x) => s1 }; push { (y) => ...; return z }; s    ~>    push { (y) => ...; s1[x -> z] }; s
+ *
+ * When the inner frame ends in a single return without touching the stack in between,
+ * the outer frame can be inlined at that return. This saves one push, one pop and one
+ * indirect call per return. The rewrite is only performed when it is safe for reference
+ * counting, that is when the frames do not share free variables, every parameter of the
+ * outer frame is used and the returned values are distinct.
+ */
+object FrameElision {
+
+  def apply(program: Program): Program = program match {
+    case Program(declarations, definitions, entry) =>
+      Program(declarations, definitions.map(transform), entry)
+  }
+
+  def transform(definition: Definition): Definition = definition match {
+    case Definition(label, body) => Definition(label, transform(body))
+  }
+
+  def transform(clause: Clause): Clause = clause match {
+    case Clause(parameters, body) => Clause(parameters, transform(body))
+  }
+
+  def transform(statement: Statement): Statement = statement match {
+    case PushFrame(frame, rest) =>
+      val outer = transform(frame)
+      transform(rest) match {
+        case rest if forwards(outer) => rest
+        case PushFrame(inner, rest) if canFuse(outer, inner) => PushFrame(fuse(outer, inner), rest)
+        case rest => PushFrame(outer, rest)
+      }
+    case Substitute(bindings, rest) => Substitute(bindings, transform(rest))
+    case Construct(name, tag, arguments, rest) => Construct(name, tag, arguments, transform(rest))
+    case Switch(scrutinee, clauses, default) =>
+      Switch(scrutinee, clauses.map { case (tag, clause) => (tag, transform(clause)) }, default.map(transform))
+    case New(name, operations, rest) => New(name, operations.map(transform), transform(rest))
+    case Var(name, init, returnType, rest) => Var(name, init, returnType, transform(rest))
+    case LoadVar(name, ref, rest) => LoadVar(name, ref, transform(rest))
+    case StoreVar(ref, value, rest) => StoreVar(ref, value, transform(rest))
+    case Reset(name, frame, rest) => Reset(name, transform(frame), transform(rest))
+    case Resume(stack, rest) => Resume(stack, transform(rest))
+    case Shift(name, prompt, rest) => Shift(name, prompt, transform(rest))
+    case ForeignCall(name, builtin, arguments, rest) => ForeignCall(name, builtin, arguments, transform(rest))
+    case LiteralInt(name, value, rest) => LiteralInt(name, value, transform(rest))
+    case LiteralDouble(name, value, rest) => LiteralDouble(name, value, transform(rest))
+    case LiteralUTF8String(name, utf8, rest) => LiteralUTF8String(name, utf8, transform(rest))
+    case Jump(_) | Invoke(_, _, _) | Return(_) | Hole => statement
+  }
+
+  def forwards(frame: Clause): Boolean = frame match {
+    case Clause(parameters, Return(values)) => values == parameters
+    case _ => false
+  }
+
+  def canFuse(outer: Clause, inner: Clause): Boolean =
+    returns(inner.body) match {
+      case List(values) =>
+        values.distinct == values &&
+          outer.parameters.toSet.subsetOf(freeVariables(outer.body)) &&
+          (freeVariables(outer) intersect freeVariables(inner)).isEmpty
+      case _ => false
+    }
+
+  def fuse(outer: Clause, inner: Clause): Clause = inner match {
+    case Clause(parameters, body) =>
+      Clause(parameters, replaceReturn(body) { values => Substitute(outer.parameters.zip(values), outer.body) })
+  }
+
+  /**
+   * The arguments of all returns in `statement`, or `Nil` if it does anything else
+   * than local computation before returning, like jumping or manipulating the stack.
+   * Branches that end in a hole do not return at all.
+   */
+  def returns(statement: Statement): List[Environment] = statement match {
+    case Return(values) => List(values)
+    case Switch(_, clauses, default) =>
+      val branches = clauses.map { case (_, clause) => clause } ++ default
+      val results = branches.map { clause => (clause.body, returns(clause.body)) }
+      if (results.exists { case (body, returned) => returned.isEmpty && body != Hole }) Nil
+      else results.flatMap { case (_, returned) => returned }
+    case Substitute(_, rest) => returns(rest)
+    case Construct(_, _, _, rest) => returns(rest)
+    case New(_, _, rest) => returns(rest)
+    case LoadVar(_, _, rest) => returns(rest)
+    case StoreVar(_, _, rest) => returns(rest)
+    case ForeignCall(_, _, _, rest) => returns(rest)
+    case LiteralInt(_, _, rest) => returns(rest)
+    case LiteralDouble(_, _, rest) => returns(rest)
+    case LiteralUTF8String(_, _, rest) => returns(rest)
+    case _ => Nil
+  }
+
+  def replaceReturn(statement: Statement)(k: Environment => Statement): Statement = statement match {
+    case Return(values) => k(values)
+    case Switch(scrutinee, clauses, default) =>
+      Switch(scrutinee,
+        clauses.map { case (tag, Clause(parameters, body)) => (tag, Clause(parameters, replaceReturn(body)(k))) },
+        default.map { case Clause(parameters, body) => Clause(parameters, replaceReturn(body)(k)) })
+    case Substitute(bindings, rest) => Substitute(bindings, replaceReturn(rest)(k))
+    case Construct(name, tag, arguments, rest) => Construct(name, tag, arguments, replaceReturn(rest)(k))
+    case New(name, operations, rest) => New(name, operations, replaceReturn(rest)(k))
+    case LoadVar(name, ref, rest) => LoadVar(name, ref, replaceReturn(rest)(k))
+    case StoreVar(ref, value, rest) => StoreVar(ref, value, replaceReturn(rest)(k))
+    case ForeignCall(name, builtin, arguments, rest) => ForeignCall(name, builtin, arguments, replaceReturn(rest)(k))
+    case LiteralInt(name, value, rest) => LiteralInt(name, value, replaceReturn(rest)(k))
+    case LiteralDouble(name, value, rest) => LiteralDouble(name, value, replaceReturn(rest)(k))
+    case LiteralUTF8String(name, utf8, rest) => LiteralUTF8String(name, utf8, replaceReturn(rest)(k))
+    case other => other
+  }
+}
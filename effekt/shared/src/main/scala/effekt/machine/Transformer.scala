@@ -47,7 +47,7 @@ object Transformer {
 
     val localDefinitions = BC.definitions
 
-    Program(declarations, toplevelDefinitions ++ localDefinitions, mainEntry)
+    FrameElision(Program(declarations, toplevelDefinitions ++ localDefinitions, mainEntry))
   }
 
   def transform(extern: core.Extern)(using BlocksParamsContext, ErrorReporter): Declaration = extern match {
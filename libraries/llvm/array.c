@@ -54,4 +54,102 @@ struct Pos c_array_set(const struct Pos arr, const Int index, const struct Pos v
   return Unit;
 }
 
+// Sets every element to `value`
+struct Pos c_array_fill(const struct Pos arr, const struct Pos value) {
+  uint64_t *sizePtr = arr.obj + sizeof(struct Header);
+  struct Pos *dataPtr = arr.obj + sizeof(struct Header) + sizeof(uint64_t);
+  uint64_t size = *sizePtr;
+  for (uint64_t i = 0; i < size; i++) {
+    sharePositive(value);
+    erasePositive(dataPtr[i]);
+    dataPtr[i] = value;
+  }
+  erasePositive(value);
+  erasePositive(arr);
+  return Unit;
+}
+
+// Copies `length` elements, the ranges may overlap.
+// Shares the copied elements before erasing the overwritten ones, so that
+// elements that are in both ranges stay alive.
+struct Pos c_array_copy(const struct Pos from, const Int start, const struct Pos to, const Int offset, const Int length) {
+  struct Pos *fromPtr = from.obj + sizeof(struct Header) + sizeof(uint64_t);
+  struct Pos *toPtr = to.obj + sizeof(struct Header) + sizeof(uint64_t);
+  for (Int i = 0; i < length; i++) {
+    sharePositive(fromPtr[start + i]);
+  }
+  for (Int i = 0; i < length; i++) {
+    erasePositive(toPtr[offset + i]);
+  }
+  memmove(toPtr + offset, fromPtr + start, length * sizeof(struct Pos));
+  erasePositive(from);
+  erasePositive(to);
+  return Unit;
+}
+
+// Decodes a UTF-8 string into an array of (boxed) characters
+struct Pos c_array_from_utf8(const struct Pos str) {
+  const uint8_t *bytes = c_bytearray_data(str);
+  uint64_t size = str.tag;
+  uint64_t count = c_utf8_count(bytes, size);
+
+  struct Pos arr = c_array_new(count);
+  struct Pos *dataPtr = arr.obj + sizeof(struct Header) + sizeof(uint64_t);
+
+  uint64_t index = 0;
+  uint64_t i = 0;
+  while (i < count) {
+    // fast path for eight ASCII characters
+    if (index + 8 <= size && i + 8 <= count &&
+        (c_bytearray_load_word(bytes + index) & c_bytearray_high_bits) == 0) {
+      for (uint64_t k = 0; k < 8; k++) {
+        dataPtr[i + k] = (struct Pos) { .tag = bytes[index + k], .obj = NULL, };
+      }
+      index += 8;
+      i += 8;
+      continue;
+    }
+    dataPtr[i] = (struct Pos) { .tag = c_utf8_decode(bytes, size, &index), .obj = NULL, };
+    i++;
+  }
+
+  erasePositive(str);
+  return arr;
+}
+
+/** Arrays of Int and Double are stored unboxed.
+ *  The tag is the size and the obj points to memory with the following layout:
+ *
+ *   +--[ Header ]--+------------------+
+ *   | Rc  | Eraser | Elements ...     |
+ *   +--------------+------------------+
+ *
+ *  Every element takes eight bytes. The eraser does nothing. Elements are read
+ *  and written by inline LLVM in intarray.effekt and doublearray.effekt, so that
+ *  loops over them can be optimized like loops over C arrays.
+ */
+
+void c_unboxed_array_erase_noop(void *envPtr) { (void)envPtr; }
+
+// All elements are zero, which is both 0 and 0.0
+struct Pos c_unboxed_array_new(const Int size) {
+  void *objPtr = calloc(sizeof(struct Header) + size * sizeof(uint64_t), 1);
+  struct Header *headerPtr = objPtr;
+  *headerPtr = (struct Header) { .rc = 0, .eraser = c_unboxed_array_erase_noop, };
+  return (struct Pos) {
+    .tag = size,
+    .obj = objPtr,
+  };
+}
+
+// Copies `length` elements, the ranges may overlap
+struct Pos c_unboxed_array_copy(const struct Pos from, const Int start, const struct Pos to, const Int offset, const Int length) {
+  uint64_t *fromPtr = from.obj + sizeof(struct Header);
+  uint64_t *toPtr = to.obj + sizeof(struct Header);
+  memmove(toPtr + offset, fromPtr + start, length * sizeof(uint64_t));
+  erasePositive(from);
+  erasePositive(to);
+  return Unit;
+}
+
 #endif
@@ -13,11 +13,56 @@
  *       +--------------+--------------+
  *
  * The eraser does nothing.
+ *
+ * Bytearrays that have been grown in place by concatenation use
+ * `c_bytearray_erase_growable` as eraser instead. It also does nothing, but
+ * marks that the contents have a capacity of `c_bytearray_capacity(size)`.
+ *
+ * Interned strings use `c_bytearray_erase_interned`, see `c_bytearray_intern`.
+ *
+ * String literals are statically allocated by the compiler with the
+ * immortal reference count -1 (see rts.ll) and are never freed.
+ *
+ * Substrings can also be slices that share the contents of their parent:
+ *
+ *       +--[ Header ]--+--------+------+
+ *       | Rc  | Eraser | Parent | Data |
+ *       +--------------+--------+------+
+ *
+ * Here, `Parent` is the bytearray we hold a reference to and `Data` points
+ * into its contents. The eraser `c_bytearray_erase_slice` erases the parent.
+ * Slices are copied before they are mutated, unless they hold the only
+ * reference to their parent.
  */
 
+struct Slice {
+  struct Pos parent;
+  uint8_t *data;
+};
 
 void c_bytearray_erase_noop(void *envPtr) { (void)envPtr; }
 
+// Must not be merged with c_bytearray_erase_noop, we compare the addresses.
+void c_bytearray_erase_growable(void *envPtr) { (void)envPtr; }
+
+void c_bytearray_erase_slice(void *envPtr) {
+  struct Slice *slice = envPtr;
+  erasePositive(slice->parent);
+}
+
+bool c_bytearray_is_slice(const struct Pos arr) {
+  struct Header *headerPtr = arr.obj;
+  return headerPtr->eraser == c_bytearray_erase_slice;
+}
+
+// Must not be merged with c_bytearray_erase_noop, we compare the addresses.
+void c_bytearray_erase_interned(void *envPtr) { (void)envPtr; }
+
+bool c_bytearray_is_interned(const struct Pos arr) {
+  struct Header *headerPtr = arr.obj;
+  return headerPtr->eraser == c_bytearray_erase_interned;
+}
+
 struct Pos c_bytearray_new(const Int size) {
   void *objPtr = malloc(sizeof(struct Header) + size);
   struct Header *headerPtr = objPtr;
@@ -28,45 +73,101 @@ struct Pos c_bytearray_new(const Int size) {
   };
 }
 
+// Internal Operations
+
+// Reads eight bytes at once, the address does not need to be aligned.
+static inline uint64_t c_bytearray_load_word(const uint8_t *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(uint64_t));
+    return word;
+}
+
+// The highest bit of every byte in a word
+static const uint64_t c_bytearray_high_bits = 0x8080808080808080;
+
+uint8_t* c_bytearray_data(const struct Pos arr) {
+    if (c_bytearray_is_slice(arr)) {
+        struct Slice *slice = arr.obj + sizeof(struct Header);
+        return slice->data;
+    }
+    uint8_t *data = arr.obj + sizeof(struct Header);
+    return data;
+}
+
+// Like c_bytearray_data, but first copies a slice if its parent is shared.
+uint8_t* c_bytearray_mutable_data(const struct Pos arr) {
+    if (c_bytearray_is_slice(arr)) {
+        struct Slice *slice = arr.obj + sizeof(struct Header);
+        struct Header *parentHeaderPtr = slice->parent.obj;
+        if (parentHeaderPtr->rc != 0) {
+            struct Pos copy = c_bytearray_new(arr.tag);
+            memcpy(c_bytearray_data(copy), slice->data, arr.tag);
+            erasePositive(slice->parent);
+            slice->parent = copy;
+            slice->data = c_bytearray_data(copy);
+        }
+        return slice->data;
+    }
+    return c_bytearray_data(arr);
+}
+
 Int c_bytearray_size(const struct Pos arr) {
   erasePositive(arr);
   return arr.tag;
 }
 
 Byte c_bytearray_get(const struct Pos arr, const Int index) {
-  Byte *dataPtr = arr.obj + sizeof(struct Header);
+  Byte *dataPtr = c_bytearray_data(arr);
   Byte element = dataPtr[index];
   erasePositive(arr);
   return element;
 }
 
 struct Pos c_bytearray_set(const struct Pos arr, const Int index, const Byte value) {
-  Byte *dataPtr = arr.obj + sizeof(struct Header);
+  Byte *dataPtr = c_bytearray_mutable_data(arr);
   dataPtr[index] = value;
   erasePositive(arr);
   return Unit;
 }
 
-// Internal Operations
-
-uint8_t* c_bytearray_data(const struct Pos arr) {
-    uint8_t *data = arr.obj + sizeof(struct Header);
-    return data;
-}
-
 struct Pos c_bytearray_construct(const uint64_t n, const uint8_t *data) {
     struct Pos arr = c_bytearray_new(n);
     memcpy(c_bytearray_data(arr), data, n);
     return arr;
 }
 
+// Literals are immortal and shared by all evaluations, and the contents of
+// interned strings are hashed in the intern table, so we copy both before
+// they can be mutated as bytearrays.
+struct Pos c_bytearray_from_string(const struct Pos str) {
+    struct Header *headerPtr = str.obj;
+    if (headerPtr->rc != (uint64_t)-1 && !c_bytearray_is_interned(str)) return str;
+    struct Pos copy = c_bytearray_construct(str.tag, c_bytearray_data(str));
+    erasePositive(str);
+    return copy;
+}
+
+// Bulk Operations
+
+struct Pos c_bytearray_fill(const struct Pos arr, const Byte value) {
+    memset(c_bytearray_mutable_data(arr), value, arr.tag);
+    erasePositive(arr);
+    return Unit;
+}
+
+// Copies `length` bytes, the ranges may overlap
+struct Pos c_bytearray_copy(const struct Pos from, const Int start, const struct Pos to, const Int offset, const Int length) {
+    uint8_t *toPtr = c_bytearray_mutable_data(to);
+    memmove(toPtr + offset, c_bytearray_data(from) + start, length);
+    erasePositive(from);
+    erasePositive(to);
+    return Unit;
+}
+
 // Complex Operations
 
 struct Pos c_bytearray_from_nullterminated_string(const char *data) {
-    uint64_t n = 0;
-    while (data[++n]);
-
-    return c_bytearray_construct(n, (uint8_t*)data);
+    return c_bytearray_construct(strlen(data), (uint8_t*)data);
 }
 
 char* c_bytearray_into_nullterminated_string(const struct Pos arr) {
@@ -82,11 +183,65 @@ char* c_bytearray_into_nullterminated_string(const struct Pos arr) {
     return result;
 }
 
-// TODO do this in Effekt
+// Number Formatting
+//
+// Numbers are formatted by hand instead of going through snprintf, writing
+// the digits straight into a bytearray of the right size.
+
+static const char c_bytearray_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t c_bytearray_powers_of_ten[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull,
+};
+
+uint64_t c_bytearray_decimal_length(const uint64_t n) {
+    uint64_t length = 1;
+    while (length < 20 && n >= c_bytearray_powers_of_ten[length]) length++;
+    return length;
+}
+
+// Writes the decimal digits of `n` backwards, ending just before `end`.
+void c_bytearray_write_decimal(uint8_t *end, uint64_t n) {
+    uint8_t *ptr = end;
+    while (n >= 100) {
+        const char *pair = c_bytearray_digit_pairs + 2 * (n % 100);
+        n /= 100;
+        *--ptr = pair[1];
+        *--ptr = pair[0];
+    }
+    if (n >= 10) {
+        const char *pair = c_bytearray_digit_pairs + 2 * n;
+        *--ptr = pair[1];
+        *--ptr = pair[0];
+    } else {
+        *--ptr = '0' + n;
+    }
+}
+
 struct Pos c_bytearray_show_Int(const Int n) {
-    char str[24];
-    snprintf(str, sizeof(str), "%" PRId64, n);
-    return c_bytearray_from_nullterminated_string(str);
+    bool negative = n < 0;
+    // negating in unsigned arithmetic also works for INT64_MIN
+    uint64_t magnitude = negative ? -(uint64_t)n : (uint64_t)n;
+    uint64_t length = c_bytearray_decimal_length(magnitude);
+
+    struct Pos str = c_bytearray_new(negative + length);
+    uint8_t *data = c_bytearray_data(str);
+    if (negative) data[0] = '-';
+    c_bytearray_write_decimal(data + str.tag, magnitude);
+    return str;
 }
 
 // TODO do this in Effekt
@@ -113,30 +268,480 @@ struct Pos c_bytearray_show_Char(const uint64_t n) {
     return c_bytearray_from_nullterminated_string(str);
 }
 
-// TODO do this in Effekt
 struct Pos c_bytearray_show_Byte(const Byte n) {
-    char str[4];  // Byte values range from 0 to 255, 3 characters + null terminator
-    snprintf(str, sizeof(str), "%" PRIu8, n);
-    return c_bytearray_from_nullterminated_string(str);
+    uint64_t length = c_bytearray_decimal_length(n);
+    struct Pos str = c_bytearray_new(length);
+    c_bytearray_write_decimal(c_bytearray_data(str) + length, n);
+    return str;
+}
+
+/**
+ * Doubles are printed with the shortest digits that read back as the same
+ * number, using the Grisu3 algorithm by Florian Loitsch ("Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010).
+ * Grisu3 detects the about 0.5% of doubles for which it cannot prove its
+ * digits shortest; those are found with snprintf and strtod instead.
+ *
+ * The digits are laid out like `Number.prototype.toString` in JavaScript does,
+ * so that all backends agree.
+ */
+
+struct DiyFp {
+    uint64_t f;
+    int e;
+};
+
+static struct DiyFp c_diyfp_sub(const struct DiyFp a, const struct DiyFp b) {
+    return (struct DiyFp) { a.f - b.f, a.e };
+}
+
+static struct DiyFp c_diyfp_mul(const struct DiyFp a, const struct DiyFp b) {
+    unsigned __int128 product = (unsigned __int128)a.f * b.f;
+    uint64_t high = product >> 64;
+    uint64_t low = (uint64_t)product;
+    high += (low >> 63) & 1; // round
+    return (struct DiyFp) { high, a.e + b.e + 64 };
+}
+
+static struct DiyFp c_diyfp_normalize(struct DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    return (struct DiyFp) { x.f << shift, x.e - shift };
+}
+
+static const uint64_t c_double_hidden_bit = 0x0010000000000000;
+static const uint64_t c_double_significand_mask = 0x000FFFFFFFFFFFFF;
+static const int c_double_exponent_bias = 0x3FF + 52;
+
+static struct DiyFp c_diyfp_from_double(const Double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(uint64_t));
+    int biased_exponent = (bits >> 52) & 0x7FF;
+    uint64_t significand = bits & c_double_significand_mask;
+    if (biased_exponent != 0) {
+        return (struct DiyFp) { significand + c_double_hidden_bit, biased_exponent - c_double_exponent_bias };
+    } else {
+        return (struct DiyFp) { significand, 1 - c_double_exponent_bias };
+    }
+}
+
+// The boundaries m- and m+ halfway to the neighbouring doubles, with a common exponent
+static void c_diyfp_boundaries(const struct DiyFp v, struct DiyFp *minus, struct DiyFp *plus) {
+    struct DiyFp upper = { (v.f << 1) + 1, v.e - 1 };
+    while (!(upper.f & (c_double_hidden_bit << 1))) {
+        upper.f <<= 1;
+        upper.e--;
+    }
+    upper.f <<= 64 - 52 - 2;
+    upper.e -= 64 - 52 - 2;
+
+    struct DiyFp lower = (v.f == c_double_hidden_bit)
+        ? (struct DiyFp) { (v.f << 2) - 1, v.e - 2 }
+        : (struct DiyFp) { (v.f << 1) - 1, v.e - 1 };
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *minus = lower;
+    *plus = upper;
+}
+
+// Normalized 10^k for k = -348, -340, ..., 340
+static const struct DiyFp c_cached_powers[] = {
+    { 0xFA8FD5A0081C0288, -1220 }, { 0xBAAEE17FA23EBF76, -1193 }, { 0x8B16FB203055AC76, -1166 },
+    { 0xCF42894A5DCE35EA, -1140 }, { 0x9A6BB0AA55653B2D, -1113 }, { 0xE61ACF033D1A45DF, -1087 },
+    { 0xAB70FE17C79AC6CA, -1060 }, { 0xFF77B1FCBEBCDC4F, -1034 }, { 0xBE5691EF416BD60C, -1007 },
+    { 0x8DD01FAD907FFC3C, -980 }, { 0xD3515C2831559A83, -954 }, { 0x9D71AC8FADA6C9B5, -927 },
+    { 0xEA9C227723EE8BCB, -901 }, { 0xAECC49914078536D, -874 }, { 0x823C12795DB6CE57, -847 },
+    { 0xC21094364DFB5637, -821 }, { 0x9096EA6F3848984F, -794 }, { 0xD77485CB25823AC7, -768 },
+    { 0xA086CFCD97BF97F4, -741 }, { 0xEF340A98172AACE5, -715 }, { 0xB23867FB2A35B28E, -688 },
+    { 0x84C8D4DFD2C63F3B, -661 }, { 0xC5DD44271AD3CDBA, -635 }, { 0x936B9FCEBB25C996, -608 },
+    { 0xDBAC6C247D62A584, -582 }, { 0xA3AB66580D5FDAF6, -555 }, { 0xF3E2F893DEC3F126, -529 },
+    { 0xB5B5ADA8AAFF80B8, -502 }, { 0x87625F056C7C4A8B, -475 }, { 0xC9BCFF6034C13053, -449 },
+    { 0x964E858C91BA2655, -422 }, { 0xDFF9772470297EBD, -396 }, { 0xA6DFBD9FB8E5B88F, -369 },
+    { 0xF8A95FCF88747D94, -343 }, { 0xB94470938FA89BCF, -316 }, { 0x8A08F0F8BF0F156B, -289 },
+    { 0xCDB02555653131B6, -263 }, { 0x993FE2C6D07B7FAC, -236 }, { 0xE45C10C42A2B3B06, -210 },
+    { 0xAA242499697392D3, -183 }, { 0xFD87B5F28300CA0E, -157 }, { 0xBCE5086492111AEB, -130 },
+    { 0x8CBCCC096F5088CC, -103 }, { 0xD1B71758E219652C, -77 }, { 0x9C40000000000000, -50 },
+    { 0xE8D4A51000000000, -24 }, { 0xAD78EBC5AC620000, 3 }, { 0x813F3978F8940984, 30 },
+    { 0xC097CE7BC90715B3, 56 }, { 0x8F7E32CE7BEA5C70, 83 }, { 0xD5D238A4ABE98068, 109 },
+    { 0x9F4F2726179A2245, 136 }, { 0xED63A231D4C4FB27, 162 }, { 0xB0DE65388CC8ADA8, 189 },
+    { 0x83C7088E1AAB65DB, 216 }, { 0xC45D1DF942711D9A, 242 }, { 0x924D692CA61BE758, 269 },
+    { 0xDA01EE641A708DEA, 295 }, { 0xA26DA3999AEF774A, 322 }, { 0xF209787BB47D6B85, 348 },
+    { 0xB454E4A179DD1877, 375 }, { 0x865B86925B9BC5C2, 402 }, { 0xC83553C5C8965D3D, 428 },
+    { 0x952AB45CFA97A0B3, 455 }, { 0xDE469FBD99A05FE3, 481 }, { 0xA59BC234DB398C25, 508 },
+    { 0xF6C69A72A3989F5C, 534 }, { 0xB7DCBF5354E9BECE, 561 }, { 0x88FCF317F22241E2, 588 },
+    { 0xCC20CE9BD35C78A5, 614 }, { 0x98165AF37B2153DF, 641 }, { 0xE2A0B5DC971F303A, 667 },
+    { 0xA8D9D1535CE3B396, 694 }, { 0xFB9B7CD9A4A7443C, 720 }, { 0xBB764C4CA7A44410, 747 },
+    { 0x8BAB8EEFB6409C1A, 774 }, { 0xD01FEF10A657842C, 800 }, { 0x9B10A4E5E9913129, 827 },
+    { 0xE7109BFBA19C0C9D, 853 }, { 0xAC2820D9623BF429, 880 }, { 0x80444B5E7AA7CF85, 907 },
+    { 0xBF21E44003ACDD2D, 933 }, { 0x8E679C2F5E44FF8F, 960 }, { 0xD433179D9C8CB841, 986 },
+    { 0x9E19DB92B4E31BA9, 1013 }, { 0xEB96BF6EBADF77D9, 1039 }, { 0xAF87023B9BF0EE6B, 1066 },
+};
+
+static struct DiyFp c_cached_power(const int e, int *k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0) ik++;
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index * 8));
+    return c_cached_powers[index];
+}
+
+// Moves the last digit towards w while it stays in the unsafe interval, then checks that
+// the digits are the closest shortest ones despite the imprecision `unit` of w and the
+// boundaries. Returns false if that cannot be decided.
+static bool c_grisu_round_weed(char *buffer, int length, uint64_t distance_too_high_w, uint64_t unsafe_interval,
+                               uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+    uint64_t small_distance = distance_too_high_w - unit;
+    uint64_t big_distance = distance_too_high_w + unit;
+    while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+           (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+    if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+        (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance)) {
+        return false;
+    }
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+static int c_decimal_length32(const uint32_t n) {
+    int length = 1;
+    while (length < 10 && n >= c_bytearray_powers_of_ten[length]) length++;
+    return length;
+}
+
+// Generates digits of a number in the unsafe interval between low and high, widened by one
+// unit for the error of the multiplication, until no further digit is needed
+static bool c_grisu_digits(const struct DiyFp low, const struct DiyFp w, const struct DiyFp high, char *buffer, int *length, int *k) {
+    uint64_t unit = 1;
+    const struct DiyFp too_low = { low.f - unit, low.e };
+    const struct DiyFp too_high = { high.f + unit, high.e };
+    uint64_t unsafe_interval = c_diyfp_sub(too_high, too_low).f;
+    const struct DiyFp one = { 1ull << -w.e, w.e };
+    uint32_t integrals = (uint32_t)(too_high.f >> -one.e);
+    uint64_t fractionals = too_high.f & (one.f - 1);
+    int kappa = c_decimal_length32(integrals);
+    *length = 0;
+
+    while (kappa > 0) {
+        uint64_t divisor = c_bytearray_powers_of_ten[kappa - 1];
+        buffer[(*length)++] = '0' + integrals / divisor;
+        integrals %= divisor;
+        kappa--;
+        uint64_t rest = ((uint64_t)integrals << -one.e) + fractionals;
+        if (rest < unsafe_interval) {
+            *k += kappa;
+            return c_grisu_round_weed(buffer, *length, c_diyfp_sub(too_high, w).f, unsafe_interval,
+                                      rest, divisor << -one.e, unit);
+        }
+    }
+
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        buffer[(*length)++] = '0' + (char)(fractionals >> -one.e);
+        fractionals &= one.f - 1;
+        kappa--;
+        if (fractionals < unsafe_interval) {
+            *k += kappa;
+            return c_grisu_round_weed(buffer, *length, c_diyfp_sub(too_high, w).f * unit, unsafe_interval,
+                                      fractionals, one.f, unit);
+        }
+    }
+}
+
+// Shortest digits of a positive, finite x such that x = digits * 10^k.
+// Returns false in the rare cases where Grisu3 cannot prove them shortest.
+static bool c_grisu3(const Double x, char *buffer, int *length, int *k) {
+    const struct DiyFp v = c_diyfp_from_double(x);
+    struct DiyFp w_m, w_p;
+    c_diyfp_boundaries(v, &w_m, &w_p);
+
+    const struct DiyFp c_mk = c_cached_power(w_p.e, k);
+    const struct DiyFp w = c_diyfp_mul(c_diyfp_normalize(v), c_mk);
+    return c_grisu_digits(c_diyfp_mul(w_m, c_mk), w, c_diyfp_mul(w_p, c_mk), buffer, length, k);
+}
+
+// Shortest digits by trying every precision with the correctly rounding snprintf and strtod
+static void c_shortest_digits_exact(const Double x, char *buffer, int *length, int *k) {
+    char str[32];
+    int precision = 1;
+    for (; precision < 17; precision++) {
+        snprintf(str, sizeof(str), "%.*e", precision - 1, x);
+        if (strtod(str, NULL) == x) break;
+    }
+    if (precision == 17) snprintf(str, sizeof(str), "%.16e", x);
+
+    // str is "d.ddde[+-]xx", or "de[+-]xx" for a single digit
+    buffer[0] = str[0];
+    if (precision > 1) memcpy(buffer + 1, str + 2, precision - 1);
+    while (precision > 1 && buffer[precision - 1] == '0') precision--;
+    *length = precision;
+    *k = atoi(strchr(str, 'e') + 1) - (precision - 1);
 }
 
-// TODO do this in Effekt
 struct Pos c_bytearray_show_Double(const Double x) {
-    char str[64]; // TODO is this large enough?
-    snprintf(str, sizeof(str), "%g", x);
-    return c_bytearray_from_nullterminated_string(str);
+    if (x != x) return c_bytearray_from_nullterminated_string("NaN");
+    if (x == 1.0 / 0.0) return c_bytearray_from_nullterminated_string("Infinity");
+    if (x == -1.0 / 0.0) return c_bytearray_from_nullterminated_string("-Infinity");
+    if (x == 0.0) return c_bytearray_from_nullterminated_string("0");
+
+    char digits[18];
+    int length;
+    int k;
+    if (!c_grisu3(x < 0 ? -x : x, digits, &length, &k)) {
+        c_shortest_digits_exact(x < 0 ? -x : x, digits, &length, &k);
+    }
+
+    // at most: sign, "0.", five zeros and 17 digits
+    char str[32];
+    int n = 0;
+    if (x < 0) str[n++] = '-';
+
+    // the decimal point is after the first `point` digits
+    int point = length + k;
+    if (length <= point && point <= 21) {
+        memcpy(str + n, digits, length); n += length;
+        memset(str + n, '0', point - length); n += point - length;
+    } else if (0 < point && point <= 21) {
+        memcpy(str + n, digits, point); n += point;
+        str[n++] = '.';
+        memcpy(str + n, digits + point, length - point); n += length - point;
+    } else if (-6 < point && point <= 0) {
+        str[n++] = '0';
+        str[n++] = '.';
+        memset(str + n, '0', -point); n += -point;
+        memcpy(str + n, digits, length); n += length;
+    } else {
+        str[n++] = digits[0];
+        if (length > 1) {
+            str[n++] = '.';
+            memcpy(str + n, digits + 1, length - 1); n += length - 1;
+        }
+        int exponent = point - 1;
+        str[n++] = 'e';
+        str[n++] = exponent < 0 ? '-' : '+';
+        uint64_t magnitude = exponent < 0 ? -exponent : exponent;
+        uint64_t exponent_length = c_bytearray_decimal_length(magnitude);
+        c_bytearray_write_decimal((uint8_t*)str + n + exponent_length, magnitude);
+        n += exponent_length;
+    }
+
+    return c_bytearray_construct(n, (uint8_t*)str);
 }
 
-// TODO do this in Effekt
+// Number Parsing
+
+// The value of every byte as a digit, 36 if it is none
+static const uint8_t c_bytearray_digit_values[256] = {
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 36, 36, 36, 36, 36, 36,
+    36, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+    25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 36, 36, 36, 36,
+    36, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+    25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+    36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36, 36,
+};
+
+static inline bool c_bytearray_is_digit(const uint8_t c) {
+    return (uint8_t)(c - '0') < 10;
+}
+
+// Eight ASCII digits at once (little endian), see Lemire's "Fast float parsing in practice"
+static inline bool c_bytearray_is_eight_digits(const uint64_t word) {
+    return ((word & 0xF0F0F0F0F0F0F0F0) |
+            (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+static inline uint64_t c_bytearray_eight_digits_value(uint64_t word) {
+    word -= 0x3030303030303030;
+    word = (word * 10) + (word >> 8);
+    return (((word & 0x000000FF000000FF) * (100 + (1000000ull << 32))) +
+            (((word >> 16) & 0x000000FF000000FF) * (1 + (10000ull << 32)))) >> 32;
+}
+
+// Parses an optional minus sign followed by digits in `base` (2 to 36).
+// Fails on any other input and if the value does not fit into an Int.
+bool c_bytearray_parse_int(const uint8_t *bytes, const uint64_t size, const uint64_t base, Int *result) {
+    bool negative = size > 0 && bytes[0] == '-';
+    uint64_t i = negative;
+    if (i == size) return false;
+
+    uint64_t magnitude = 0;
+    if (base == 10) {
+        while (i + 8 <= size && c_bytearray_is_eight_digits(c_bytearray_load_word(bytes + i))) {
+            if (__builtin_mul_overflow(magnitude, 100000000, &magnitude) ||
+                __builtin_add_overflow(magnitude, c_bytearray_eight_digits_value(c_bytearray_load_word(bytes + i)), &magnitude)) {
+                return false;
+            }
+            i += 8;
+        }
+    }
+    for (; i < size; i++) {
+        uint64_t digit = c_bytearray_digit_values[bytes[i]];
+        if (digit >= base) return false;
+        if (__builtin_mul_overflow(magnitude, base, &magnitude) ||
+            __builtin_add_overflow(magnitude, digit, &magnitude)) {
+            return false;
+        }
+    }
+
+    if (magnitude > (uint64_t)INT64_MAX + negative) return false;
+    *result = negative ? (Int)(0 - magnitude) : (Int)magnitude;
+    return true;
+}
+
+struct Pos c_bytearray_is_int(const struct Pos str, const Int base) {
+    Int result;
+    bool valid = c_bytearray_parse_int(c_bytearray_data(str), str.tag, base, &result);
+    erasePositive(str);
+    return valid ? BooleanTrue : BooleanFalse;
+}
+
+// Returns 0 if the string is not an Int, use c_bytearray_is_int to check first.
+Int c_bytearray_to_int(const struct Pos str, const Int base) {
+    Int result = 0;
+    c_bytearray_parse_int(c_bytearray_data(str), str.tag, base, &result);
+    erasePositive(str);
+    return result;
+}
+
+static const double c_bytearray_exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Parses numbers of the form `[+-]?(digits[.digits?]|.digits)([eE][+-]?digits)?`
+ * and returns NaN on any other input.
+ *
+ * Mantissas of at most 19 digits that fit into a double, scaled by an exactly
+ * representable power of ten, are computed directly with a single, correctly
+ * rounded multiplication or division (Clinger's fast path). Everything else
+ * falls back to strtod.
+ */
+Double c_bytearray_parse_double(const uint8_t *bytes, const uint64_t size) {
+    uint64_t i = 0;
+    bool negative = false;
+    if (i < size && (bytes[i] == '-' || bytes[i] == '+')) {
+        negative = bytes[i] == '-';
+        i++;
+    }
+
+    uint64_t mantissa = 0;
+    uint64_t significant_digits = 0;
+    int64_t exponent = 0;
+
+    uint64_t integer_start = i;
+    for (; i < size && c_bytearray_is_digit(bytes[i]); i++) {
+        mantissa = mantissa * 10 + (bytes[i] - '0');
+        significant_digits += mantissa != 0;
+    }
+    uint64_t digits = i - integer_start;
+
+    if (i < size && bytes[i] == '.') {
+        i++;
+        uint64_t fraction_start = i;
+        for (; i < size && c_bytearray_is_digit(bytes[i]); i++) {
+            mantissa = mantissa * 10 + (bytes[i] - '0');
+            significant_digits += mantissa != 0;
+        }
+        digits += i - fraction_start;
+        exponent = -(int64_t)(i - fraction_start);
+    }
+    if (digits == 0) return 0.0 / 0.0;
+
+    if (i < size && (bytes[i] == 'e' || bytes[i] == 'E')) {
+        i++;
+        bool negative_exponent = false;
+        if (i < size && (bytes[i] == '-' || bytes[i] == '+')) {
+            negative_exponent = bytes[i] == '-';
+            i++;
+        }
+        uint64_t exponent_start = i;
+        int64_t explicit_exponent = 0;
+        for (; i < size && c_bytearray_is_digit(bytes[i]); i++) {
+            // saturate, such exponents over- or underflow anyway
+            if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (bytes[i] - '0');
+        }
+        if (i == exponent_start) return 0.0 / 0.0;
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+    if (i != size) return 0.0 / 0.0;
+
+    if (significant_digits <= 19 && mantissa <= (1ull << 53) && -22 <= exponent && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0
+            ? value / c_bytearray_exact_powers_of_ten[-exponent]
+            : value * c_bytearray_exact_powers_of_ten[exponent];
+        return negative ? -value : value;
+    }
+
+    char buffer[64];
+    char *copy = size < sizeof(buffer) ? buffer : malloc(size + 1);
+    memcpy(copy, bytes, size);
+    copy[size] = '\0';
+    Double value = strtod(copy, NULL);
+    if (copy != buffer) free(copy);
+    return value;
+}
+
+Double c_bytearray_to_double(const struct Pos str) {
+    Double value = c_bytearray_parse_double(c_bytearray_data(str), str.tag);
+    erasePositive(str);
+    return value;
+}
+
+// The capacity of a growable bytearray of the given size (next power of two).
+uint64_t c_bytearray_capacity(const uint64_t size) {
+    uint64_t capacity = 16;
+    while (capacity < size) capacity *= 2;
+    return capacity;
+}
+
+/**
+ * If we hold the only reference to `left`, we append to it in place.
+ * Its buffer grows geometrically, so chains like `s = s ++ t` in a loop
+ * are amortized linear instead of quadratic.
+ */
 struct Pos c_bytearray_concatenate(const struct Pos left, const struct Pos right) {
     uint64_t left_size = left.tag;
     uint64_t right_size = right.tag;
-    const struct Pos concatenated = c_bytearray_new(left_size + right_size);
-    for (uint64_t j = 0; j < concatenated.tag; ++j)
-        c_bytearray_data(concatenated)[j]
-            = j < left_size
-            ? c_bytearray_data(left)[j]
-            : c_bytearray_data(right)[j - left_size];
+    uint64_t size = left_size + right_size;
+    struct Header *left_header = left.obj;
+
+    bool growable = left_header->eraser == c_bytearray_erase_growable;
+    bool flat = growable || left_header->eraser == c_bytearray_erase_noop;
+
+    if (flat && left_header->rc == 0) {
+        if (!growable || size > c_bytearray_capacity(left_size)) {
+            left_header = realloc(left_header, sizeof(struct Header) + c_bytearray_capacity(size));
+            left_header->eraser = c_bytearray_erase_growable;
+        }
+        const struct Pos appended = (struct Pos) { .tag = size, .obj = left_header, };
+        memcpy(c_bytearray_data(appended) + left_size, c_bytearray_data(right), right_size);
+
+        erasePositive(right);
+        return appended;
+    }
+
+    const struct Pos concatenated = c_bytearray_new(size);
+
+    // memcpy is vectorized by the C library and dispatches on the CPU at runtime
+    uint8_t *data = c_bytearray_data(concatenated);
+    memcpy(data, c_bytearray_data(left), left_size);
+    memcpy(data + left_size, c_bytearray_data(right), right_size);
 
     erasePositive(left);
     erasePositive(right);
@@ -153,7 +758,17 @@ struct Pos c_bytearray_equal(const struct Pos left, const struct Pos right) {
         return BooleanFalse;
     }
 
-    int cmp = memcmp(c_bytearray_data(left), c_bytearray_data(right), left_size);
+    if (c_bytearray_is_interned(left) && c_bytearray_is_interned(right)) {
+        bool same = left.obj == right.obj;
+        erasePositive(left);
+        erasePositive(right);
+        return (same ? BooleanTrue : BooleanFalse);
+    }
+
+    uint8_t* left_data = c_bytearray_data(left);
+    uint8_t* right_data = c_bytearray_data(right);
+
+    int cmp = (left_data == right_data) ? 0 : memcmp(left_data, right_data, left_size);
     erasePositive(left);
     erasePositive(right);
     return (cmp == 0 ? BooleanTrue : BooleanFalse);
@@ -167,9 +782,9 @@ Int c_bytearray_compare(const struct Pos left, const struct Pos right) {
     uint8_t* left_data = c_bytearray_data(left);
     uint8_t* right_data = c_bytearray_data(right);
 
-    if (left_data == right_data) {
+    if (left_data == right_data && left_size == right_size) {
         erasePositive(left);
-        erasePositive(right);   
+        erasePositive(right);
         return 0;
     }
 
@@ -193,14 +808,189 @@ Int c_bytearray_compare(const struct Pos left, const struct Pos right) {
     return 0;
 }
 
+// Hashing
+
+// Follows wyhash by Wang Yi, which reads eight or sixteen
+// bytes per step and mixes them with a 64x64->128 bit multiplication.
+
+static const uint64_t c_bytearray_hash_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull,
+};
+
+// Multiplies and folds the two halves of the 128 bit product
+static inline uint64_t c_bytearray_hash_mix(const uint64_t a, const uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t c_bytearray_load_half_word(const uint8_t *bytes) {
+    uint32_t half;
+    memcpy(&half, bytes, sizeof(uint32_t));
+    return half;
+}
+
+uint64_t c_bytearray_hash_bytes(const uint8_t *bytes, const uint64_t size, uint64_t seed) {
+    const uint64_t *secret = c_bytearray_hash_secret;
+    seed ^= c_bytearray_hash_mix(seed ^ secret[0], secret[1]);
+    uint64_t a, b;
+    if (size <= 16) {
+        if (size >= 4) {
+            uint64_t middle = (size >> 3) << 2;
+            a = (c_bytearray_load_half_word(bytes) << 32) | c_bytearray_load_half_word(bytes + middle);
+            b = (c_bytearray_load_half_word(bytes + size - 4) << 32) | c_bytearray_load_half_word(bytes + size - 4 - middle);
+        } else if (size > 0) {
+            a = ((uint64_t)bytes[0] << 16) | ((uint64_t)bytes[size >> 1] << 8) | bytes[size - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        const uint8_t *p = bytes;
+        uint64_t remaining = size;
+        if (remaining > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = c_bytearray_hash_mix(c_bytearray_load_word(p) ^ secret[1], c_bytearray_load_word(p + 8) ^ seed);
+                seed1 = c_bytearray_hash_mix(c_bytearray_load_word(p + 16) ^ secret[2], c_bytearray_load_word(p + 24) ^ seed1);
+                seed2 = c_bytearray_hash_mix(c_bytearray_load_word(p + 32) ^ secret[3], c_bytearray_load_word(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (remaining > 16) {
+            seed = c_bytearray_hash_mix(c_bytearray_load_word(p) ^ secret[1], c_bytearray_load_word(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+        a = c_bytearray_load_word(p + remaining - 16);
+        b = c_bytearray_load_word(p + remaining - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    __uint128_t product = (__uint128_t)a * b;
+    a = (uint64_t)product;
+    b = (uint64_t)(product >> 64);
+    return c_bytearray_hash_mix(a ^ secret[0] ^ size, b ^ secret[1]);
+}
+
+Int c_bytearray_hash(const struct Pos arr) {
+    uint64_t hash = c_bytearray_hash_bytes(c_bytearray_data(arr), arr.tag, 0);
+    erasePositive(arr);
+    return hash;
+}
+
+// Interning
+//
+// Interned strings live in a global open addressing table that holds one
+// reference to each of them, so they are never freed. They use their own
+// eraser, which marks them as canonical: two interned strings are equal if
+// and only if they are the same object.
+
+struct InternEntry {
+    uint64_t hash;
+    struct Pos str;
+};
+
+static struct InternEntry *c_bytearray_intern_table = NULL;
+static uint64_t c_bytearray_intern_capacity = 0;
+static uint64_t c_bytearray_intern_count = 0;
+
+static void c_bytearray_intern_grow(void) {
+    uint64_t capacity = c_bytearray_intern_capacity == 0 ? 256 : c_bytearray_intern_capacity * 2;
+    struct InternEntry *table = calloc(capacity, sizeof(struct InternEntry));
+    for (uint64_t i = 0; i < c_bytearray_intern_capacity; i++) {
+        struct InternEntry entry = c_bytearray_intern_table[i];
+        if (entry.str.obj == NULL) continue;
+        uint64_t j = entry.hash & (capacity - 1);
+        while (table[j].str.obj != NULL) j = (j + 1) & (capacity - 1);
+        table[j] = entry;
+    }
+    free(c_bytearray_intern_table);
+    c_bytearray_intern_table = table;
+    c_bytearray_intern_capacity = capacity;
+}
+
+/**
+ * Returns the canonical string with the contents of `str`, adding a copy of
+ * `str` to the table if there is none yet. The copy is skipped if we hold the
+ * only reference to a plain `str`.
+ */
+struct Pos c_bytearray_intern(const struct Pos str) {
+    if (c_bytearray_is_interned(str)) return str;
+
+    const uint8_t *data = c_bytearray_data(str);
+    uint64_t size = str.tag;
+    uint64_t hash = c_bytearray_hash_bytes(data, size, 0);
+
+    if (2 * (c_bytearray_intern_count + 1) > c_bytearray_intern_capacity) c_bytearray_intern_grow();
+
+    uint64_t mask = c_bytearray_intern_capacity - 1;
+    uint64_t i = hash & mask;
+    for (struct InternEntry *entry = &c_bytearray_intern_table[i]; entry->str.obj != NULL;
+         i = (i + 1) & mask, entry = &c_bytearray_intern_table[i]) {
+        if (entry->hash == hash && entry->str.tag == str.tag &&
+            memcmp(c_bytearray_data(entry->str), data, size) == 0) {
+            erasePositive(str);
+            sharePositive(entry->str);
+            return entry->str;
+        }
+    }
+
+    struct Pos canonical = str;
+    struct Header *headerPtr = str.obj;
+    if (headerPtr->rc != 0 || headerPtr->eraser != c_bytearray_erase_noop) {
+        canonical = c_bytearray_construct(size, data);
+        erasePositive(str);
+    }
+    ((struct Header*)canonical.obj)->eraser = c_bytearray_erase_interned;
+
+    c_bytearray_intern_table[i] = (struct InternEntry) { .hash = hash, .str = canonical, };
+    c_bytearray_intern_count++;
+    sharePositive(canonical);
+    return canonical;
+}
+
+// Substrings shorter than this are copied, since a slice would not be cheaper.
+static const uint64_t c_bytearray_slice_min_size = 64;
+
+// Substrings smaller than this fraction of their parent are copied, so that
+// they do not keep a much larger parent alive.
+static const uint64_t c_bytearray_slice_max_ratio = 16;
+
 // TODO deprecate
 struct Pos c_bytearray_substring(const struct Pos str, uint64_t start, uint64_t end) {
-    const struct Pos substr = c_bytearray_new(end - start);
-    for (uint64_t j = 0; j < substr.tag; ++j) {
-        c_bytearray_data(substr)[j] = c_bytearray_data(str)[start+j];
+    uint64_t size = end - start;
+
+    if (start == 0 && end == str.tag) return str;
+
+    struct Pos parent = str;
+    if (c_bytearray_is_slice(str)) {
+        struct Slice *slice = str.obj + sizeof(struct Header);
+        parent = slice->parent;
+    }
+
+    if (size < c_bytearray_slice_min_size || size * c_bytearray_slice_max_ratio < parent.tag) {
+        const struct Pos substr = c_bytearray_new(size);
+        memcpy(c_bytearray_data(substr), c_bytearray_data(str) + start, size);
+        erasePositive(str);
+        return substr;
     }
+
+    void *objPtr = malloc(sizeof(struct Header) + sizeof(struct Slice));
+    struct Header *headerPtr = objPtr;
+    struct Slice *slice = objPtr + sizeof(struct Header);
+    *headerPtr = (struct Header) { .rc = 0, .eraser = c_bytearray_erase_slice, };
+    *slice = (struct Slice) { .parent = parent, .data = c_bytearray_data(str) + start, };
+
+    // we transfer our reference from `str` to the `parent`
+    sharePositive(parent);
     erasePositive(str);
-    return substr;
+
+    return (struct Pos) {
+        .tag = size,
+        .obj = objPtr,
+    };
 }
 
 // TODO deprecate
@@ -241,4 +1031,219 @@ uint32_t c_bytearray_character_at(const struct Pos str, const uint64_t index) {
     return character;
 }
 
+// Substring Search
+
+// Needles at least this long are searched with Boyer-Moore-Horspool
+static const uint64_t c_bytearray_horspool_min_size = 16;
+
+// Index of the first occurrence of `needle` in `haystack`, or -1
+Int c_bytearray_find(const uint8_t *haystack, const uint64_t size, const uint8_t *needle, const uint64_t needle_size) {
+    if (needle_size == 0) return 0;
+    if (needle_size > size) return -1;
+
+    const uint8_t first = needle[0];
+    const uint64_t last_start = size - needle_size;
+
+    if (needle_size < c_bytearray_horspool_min_size) {
+        // memchr is vectorized by the C library, it filters candidates by their first byte
+        const uint8_t *candidate = haystack;
+        const uint8_t *end = haystack + last_start + 1;
+        while ((candidate = memchr(candidate, first, end - candidate)) != NULL) {
+            if (memcmp(candidate + 1, needle + 1, needle_size - 1) == 0) return candidate - haystack;
+            candidate++;
+        }
+        return -1;
+    }
+
+    uint64_t shift[256];
+    for (int i = 0; i < 256; i++) shift[i] = needle_size;
+    for (uint64_t i = 0; i < needle_size - 1; i++) shift[needle[i]] = needle_size - 1 - i;
+
+    const uint8_t last = needle[needle_size - 1];
+    uint64_t position = 0;
+    while (position <= last_start) {
+        uint8_t current = haystack[position + needle_size - 1];
+        if (current == last && haystack[position] == first &&
+            memcmp(haystack + position, needle, needle_size - 1) == 0) {
+            return position;
+        }
+        position += shift[current];
+    }
+    return -1;
+}
+
+// Index of the last occurrence of `needle` in `haystack` that starts at or before `from`, or -1
+Int c_bytearray_find_last(const uint8_t *haystack, const uint64_t size, const uint8_t *needle, const uint64_t needle_size, uint64_t from) {
+    if (needle_size > size) return -1;
+    if (from > size - needle_size) from = size - needle_size;
+    if (needle_size == 0) return from;
+
+    const uint8_t first = needle[0];
+    for (uint64_t position = from + 1; position-- > 0;) {
+        if (haystack[position] == first && memcmp(haystack + position, needle, needle_size) == 0) {
+            return position;
+        }
+    }
+    return -1;
+}
+
+Int c_bytearray_index_of(const struct Pos str, const struct Pos sub, const Int from) {
+    Int index = -1;
+    uint64_t start = from < 0 ? 0 : from;
+    if (start < str.tag) {
+        index = c_bytearray_find(c_bytearray_data(str) + start, str.tag - start, c_bytearray_data(sub), sub.tag);
+        if (index >= 0) index += start;
+    }
+    erasePositive(str);
+    erasePositive(sub);
+    return index;
+}
+
+Int c_bytearray_last_index_of(const struct Pos str, const struct Pos sub, const Int from) {
+    Int index = -1;
+    if (from >= 0) {
+        index = c_bytearray_find_last(c_bytearray_data(str), str.tag, c_bytearray_data(sub), sub.tag, from);
+    }
+    erasePositive(str);
+    erasePositive(sub);
+    return index;
+}
+
+static inline bool c_bytearray_is_whitespace(const uint8_t c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Removes leading and trailing ASCII whitespace, sharing the contents where possible
+struct Pos c_bytearray_trim(const struct Pos str) {
+    const uint8_t *bytes = c_bytearray_data(str);
+    uint64_t start = 0;
+    uint64_t end = str.tag;
+    while (start < end && c_bytearray_is_whitespace(bytes[start])) start++;
+    while (end > start && c_bytearray_is_whitespace(bytes[end - 1])) end--;
+    return c_bytearray_substring(str, start, end);
+}
+
+// UTF-8
+//
+// The kernels below process eight bytes at a time where possible (SWAR).
+// Runs of ASCII are detected by checking the high bit of every byte in a word.
+
+bool c_utf8_valid(const uint8_t *bytes, const uint64_t size) {
+    uint64_t i = 0;
+    while (i < size) {
+        if (i + 8 <= size && (c_bytearray_load_word(bytes + i) & c_bytearray_high_bits) == 0) {
+            i += 8;
+            continue;
+        }
+
+        uint8_t first_byte = bytes[i];
+        if (first_byte < 0x80) {
+            i++;
+            continue;
+        }
+
+        uint64_t width;
+        uint32_t character;
+        uint32_t minimum;
+        if ((first_byte & 0xE0) == 0xC0) {
+            width = 2; character = first_byte & 0x1F; minimum = 0x80;
+        } else if ((first_byte & 0xF0) == 0xE0) {
+            width = 3; character = first_byte & 0x0F; minimum = 0x800;
+        } else if ((first_byte & 0xF8) == 0xF0) {
+            width = 4; character = first_byte & 0x07; minimum = 0x10000;
+        } else {
+            return false;
+        }
+
+        if (i + width > size) return false;
+
+        for (uint64_t k = 1; k < width; k++) {
+            uint8_t byte = bytes[i + k];
+            if ((byte & 0xC0) != 0x80) return false;
+            character = (character << 6) | (byte & 0x3F);
+        }
+
+        // overlong encodings, surrogates and out of range code points
+        if (character < minimum || character > 0x10FFFF || (character >= 0xD800 && character <= 0xDFFF)) {
+            return false;
+        }
+
+        i += width;
+    }
+    return true;
+}
+
+// Counts the bytes that are not continuation bytes (10xxxxxx).
+uint64_t c_utf8_count(const uint8_t *bytes, const uint64_t size) {
+    uint64_t count = 0;
+    uint64_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = c_bytearray_load_word(bytes + i);
+        // high bit set and second highest bit cleared
+        uint64_t continuation = word & ~(word << 1) & c_bytearray_high_bits;
+        count += 8 - __builtin_popcountll(continuation);
+    }
+    for (; i < size; i++) {
+        count += (bytes[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+// Decodes the code point starting at `bytes[*index]` and advances the index.
+//
+// Stray continuation bytes are skipped. Invalid leading bytes, sequences that
+// are truncated by the end of the input or by a byte that is not a continuation
+// byte, and sequences that c_utf8_valid rejects (overlong encodings, surrogates
+// and code points above U+10FFFF) are decoded to U+FFFD; the bytes after a
+// truncated sequence are decoded on their own. This way the number of decoded
+// code points agrees with c_utf8_count. Past the end, U+FFFD is returned.
+uint32_t c_utf8_decode(const uint8_t *bytes, const uint64_t size, uint64_t *index) {
+    uint64_t i = *index;
+    while (i < size && (bytes[i] & 0xC0) == 0x80) i++;
+    if (i >= size) {
+        *index = size;
+        return 0xFFFD;
+    }
+
+    uint8_t first_byte = bytes[i];
+    uint64_t width;
+    uint32_t character;
+    uint32_t minimum;
+    if (first_byte < 0x80) {
+        *index = i + 1;
+        return first_byte;
+    } else if ((first_byte & 0xE0) == 0xC0) {
+        width = 2; character = first_byte & 0x1F; minimum = 0x80;
+    } else if ((first_byte & 0xF0) == 0xE0) {
+        width = 3; character = first_byte & 0x0F; minimum = 0x800;
+    } else if ((first_byte & 0xF8) == 0xF0) {
+        width = 4; character = first_byte & 0x07; minimum = 0x10000;
+    } else {
+        *index = i + 1;
+        return 0xFFFD;
+    }
+
+    uint64_t k = 1;
+    for (; k < width && i + k < size && (bytes[i + k] & 0xC0) == 0x80; k++) {
+        character = (character << 6) | (bytes[i + k] & 0x3F);
+    }
+    *index = i + k;
+    if (k < width || character < minimum || character > 0x10FFFF || (character >= 0xD800 && character <= 0xDFFF)) {
+        return 0xFFFD;
+    }
+    return character;
+}
+
+struct Pos c_bytearray_utf8_valid(const struct Pos str) {
+    bool valid = c_utf8_valid(c_bytearray_data(str), str.tag);
+    erasePositive(str);
+    return valid ? BooleanTrue : BooleanFalse;
+}
+
+Int c_bytearray_utf8_count(const struct Pos str) {
+    uint64_t count = c_utf8_count(c_bytearray_data(str), str.tag);
+    erasePositive(str);
+    return count;
+}
+
 #endif
@@ -19,14 +19,35 @@ declare %Pos @c_array_new(%Int)
 declare %Int @c_array_size(%Pos)
 declare %Pos @c_array_get(%Pos, %Int)
 declare %Pos @c_array_set(%Pos, %Int, %Pos)
+declare %Pos @c_array_fill(%Pos, %Pos)
+declare %Pos @c_array_copy(%Pos, %Int, %Pos, %Int, %Int)
+declare %Pos @c_array_from_utf8(%Pos)
+declare %Pos @c_unboxed_array_new(%Int)
+declare %Pos @c_unboxed_array_copy(%Pos, %Int, %Pos, %Int, %Int)
+
+declare %Pos @c_regex_compile(%Pos)
+declare %Pos @c_regex_exec(%Pos, %Pos)
+declare %Pos @c_regex_match_found(%Pos)
+declare %Int @c_regex_match_index(%Pos)
+declare %Pos @c_regex_match_matched(%Pos)
+
+declare %Int @c_json_skip_whitespace(%Pos, %Int)
+declare %Int @c_json_string_end(%Pos, %Int)
+declare %Pos @c_json_unescape(%Pos, %Int, %Int)
+declare %Int @c_json_number_end(%Pos, %Int)
+declare %Double @c_json_number(%Pos, %Int, %Int)
 
 declare %Pos @c_bytearray_new(%Int)
 declare %Int @c_bytearray_size(%Pos)
 declare %Byte @c_bytearray_get(%Pos, %Int)
 declare %Pos @c_bytearray_set(%Pos, %Int, %Byte)
+declare %Pos @c_bytearray_fill(%Pos, %Byte)
+declare %Pos @c_bytearray_copy(%Pos, %Int, %Pos, %Int, %Int)
 
 declare ptr @c_bytearray_data(%Pos)
 declare %Pos @c_bytearray_construct(i64, ptr)
+declare %Pos @c_bytearray_from_string(%Pos)
+declare void @c_bytearray_erase_noop(ptr)
 
 declare %Pos @c_bytearray_from_nullterminated_string(ptr)
 declare ptr @c_bytearray_into_nullterminated_string(%Pos)
@@ -36,10 +57,23 @@ declare %Pos @c_bytearray_show_Char(i32)
 declare %Pos @c_bytearray_show_Byte(i8)
 declare %Pos @c_bytearray_show_Double(double)
 
+declare %Pos @c_bytearray_is_int(%Pos, %Int)
+declare %Int @c_bytearray_to_int(%Pos, %Int)
+declare %Double @c_bytearray_to_double(%Pos)
+
 declare %Pos @c_bytearray_concatenate(%Pos, %Pos)
 declare %Pos @c_bytearray_equal(%Pos, %Pos)
 declare %Int @c_bytearray_compare(%Pos, %Pos)
+declare %Int @c_bytearray_hash(%Pos)
+declare %Pos @c_bytearray_intern(%Pos)
 
 declare %Pos @c_bytearray_substring(%Pos, i64, i64)
 declare %Int @c_bytearray_character_at(%Pos, i64)
 
+declare %Int @c_bytearray_index_of(%Pos, %Pos, %Int)
+declare %Int @c_bytearray_last_index_of(%Pos, %Pos, %Int)
+declare %Pos @c_bytearray_trim(%Pos)
+
+declare %Pos @c_bytearray_utf8_valid(%Pos)
+declare %Int @c_bytearray_utf8_count(%Pos)
+
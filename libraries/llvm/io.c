@@ -99,7 +99,7 @@ void c_fs_open_appending(String path, Stack stack) {
 
 void c_fs_read(Int file, struct Pos buffer, Int offset, Int size, Int position, Stack stack) {
 
-    uv_buf_t buf = uv_buf_init((char*)(c_bytearray_data(buffer) + offset), size);
+    uv_buf_t buf = uv_buf_init((char*)(c_bytearray_mutable_data(buffer) + offset), size);
     erasePositive(buffer);
     // TODO panic if this was the last reference
 
@@ -0,0 +1,229 @@
+#ifndef EFFEKT_JSON_C
+#define EFFEKT_JSON_C
+
+/** Scanning primitives for decoding json from the UTF-8 bytes of a bytearray.
+ *
+ *  Each function finds the end of one token, starting at the given index, so that
+ *  the decoder in json.effekt can hand whole strings and numbers to the builder.
+ *  Indices past the end of the input are treated like the end of the input.
+ */
+
+// Internal Operations
+
+static inline bool c_json_is_whitespace(const uint8_t c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// The lowest bit of every byte in a word
+static const uint64_t c_json_low_bits = 0x0101010101010101;
+
+// Whether any byte of the word is '"', '\\' or a control character
+static inline bool c_json_has_special(const uint64_t word) {
+    uint64_t quote = word ^ (c_json_low_bits * '"');
+    uint64_t backslash = word ^ (c_json_low_bits * '\\');
+    uint64_t zero_quote = (quote - c_json_low_bits) & ~quote;
+    uint64_t zero_backslash = (backslash - c_json_low_bits) & ~backslash;
+    uint64_t control = (word - c_json_low_bits * 0x20) & ~word;
+    return ((zero_quote | zero_backslash | control) & c_bytearray_high_bits) != 0;
+}
+
+static inline uint32_t c_json_hex4(const uint8_t *bytes) {
+    uint32_t value = 0;
+    for (int k = 0; k < 4; k++) {
+        value = value * 16 + c_bytearray_digit_values[bytes[k]];
+    }
+    return value;
+}
+
+static inline bool c_json_is_hex4(const uint8_t *bytes) {
+    for (int k = 0; k < 4; k++) {
+        if (c_bytearray_digit_values[bytes[k]] >= 16) return false;
+    }
+    return true;
+}
+
+static inline uint8_t* c_json_write_utf8(uint8_t *out, const uint32_t n) {
+    if (n < 0x80) {
+        *out++ = n;
+    } else if (n < 0x800) {
+        *out++ = 0xC0 | (n >> 6);
+        *out++ = 0x80 | (n & 0x3F);
+    } else if (n < 0x10000) {
+        *out++ = 0xE0 | (n >> 12);
+        *out++ = 0x80 | ((n >> 6) & 0x3F);
+        *out++ = 0x80 | (n & 0x3F);
+    } else {
+        *out++ = 0xF0 | (n >> 18);
+        *out++ = 0x80 | ((n >> 12) & 0x3F);
+        *out++ = 0x80 | ((n >> 6) & 0x3F);
+        *out++ = 0x80 | (n & 0x3F);
+    }
+    return out;
+}
+
+// Exported Functions
+
+/**
+ * Returns the index of the first byte at or after `from` that is not whitespace.
+ */
+Int c_json_skip_whitespace(const struct Pos arr, const Int from) {
+    const uint8_t *bytes = c_bytearray_data(arr);
+    uint64_t size = arr.tag;
+    uint64_t i = from;
+    while (i < size && c_json_is_whitespace(bytes[i])) i++;
+    erasePositive(arr);
+    return i;
+}
+
+/**
+ * Returns the index of the quote that closes the string whose contents start at
+ * `from`, or -1 if the string is unterminated or contains invalid escapes or
+ * unescaped control characters.
+ *
+ * Plain runs of characters are skipped eight bytes at a time.
+ */
+Int c_json_string_end(const struct Pos arr, const Int from) {
+    const uint8_t *bytes = c_bytearray_data(arr);
+    uint64_t size = arr.tag;
+    uint64_t i = from;
+    Int result = -1;
+    while (i < size) {
+        if (i + 8 <= size && !c_json_has_special(c_bytearray_load_word(bytes + i))) {
+            i += 8;
+            continue;
+        }
+        uint8_t c = bytes[i];
+        if (c == '"') {
+            result = i;
+            break;
+        } else if (c == '\\') {
+            if (i + 1 >= size) break;
+            uint8_t escaped = bytes[i + 1];
+            if (escaped == 'u') {
+                if (i + 6 > size || !c_json_is_hex4(bytes + i + 2)) break;
+                i += 6;
+            } else if (escaped == '"' || escaped == '\\' || escaped == '/' || escaped == 'b' ||
+                       escaped == 'f' || escaped == 'n' || escaped == 'r' || escaped == 't') {
+                i += 2;
+            } else {
+                break;
+            }
+        } else if (c < 0x20) {
+            break;
+        } else {
+            i++;
+        }
+    }
+    erasePositive(arr);
+    return result;
+}
+
+/**
+ * Returns a fresh string with the contents of the string between `from` and `to`,
+ * with all escapes replaced. Expects a span validated by `c_json_string_end`.
+ *
+ * Escaped surrogate pairs are combined, lone surrogates become U+FFFD.
+ */
+struct Pos c_json_unescape(const struct Pos arr, const Int from, const Int to) {
+    const uint8_t *bytes = c_bytearray_data(arr) + from;
+    uint64_t size = to - from;
+
+    const uint8_t *escape = memchr(bytes, '\\', size);
+    if (escape == NULL) {
+        struct Pos str = c_bytearray_construct(size, bytes);
+        erasePositive(arr);
+        return str;
+    }
+
+    // escapes never decode to more bytes than they take up
+    uint8_t buffer[256];
+    uint8_t *result = size <= sizeof(buffer) ? buffer : malloc(size);
+    uint64_t prefix = escape - bytes;
+    memcpy(result, bytes, prefix);
+    uint8_t *out = result + prefix;
+
+    uint64_t i = prefix;
+    while (i < size) {
+        uint8_t c = bytes[i];
+        if (c != '\\') {
+            *out++ = c;
+            i++;
+            continue;
+        }
+        uint8_t escaped = bytes[i + 1];
+        i += 2;
+        switch (escaped) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                uint32_t code = c_json_hex4(bytes + i);
+                i += 4;
+                if (code >= 0xD800 && code < 0xDC00 && i + 6 <= size && bytes[i] == '\\' && bytes[i + 1] == 'u') {
+                    uint32_t low = c_json_hex4(bytes + i + 2);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                if (code >= 0xD800 && code < 0xE000) code = 0xFFFD;
+                out = c_json_write_utf8(out, code);
+                break;
+            }
+            default: *out++ = escaped; break;
+        }
+    }
+
+    struct Pos str = c_bytearray_construct(out - result, result);
+    if (result != buffer) free(result);
+    erasePositive(arr);
+    return str;
+}
+
+// Skips the digits at `i` and returns the index after them, or -1 if there are none
+static inline int64_t c_json_digits(const uint8_t *bytes, const uint64_t size, uint64_t i) {
+    if (i >= size || !c_bytearray_is_digit(bytes[i])) return -1;
+    while (i < size && c_bytearray_is_digit(bytes[i])) i++;
+    return i;
+}
+
+// Returns the index after the number starting at `i`, or -1 if it is malformed
+static int64_t c_json_scan_number(const uint8_t *bytes, const uint64_t size, int64_t i) {
+    if (i < (int64_t)size && bytes[i] == '-') i++;
+    i = (i < (int64_t)size && bytes[i] == '0') ? i + 1 : c_json_digits(bytes, size, i);
+    if (i < 0) return -1;
+
+    if (i < (int64_t)size && bytes[i] == '.') {
+        i = c_json_digits(bytes, size, i + 1);
+        if (i < 0) return -1;
+    }
+    if (i < (int64_t)size && (bytes[i] == 'e' || bytes[i] == 'E')) {
+        i++;
+        if (i < (int64_t)size && (bytes[i] == '-' || bytes[i] == '+')) i++;
+        i = c_json_digits(bytes, size, i);
+    }
+    return i;
+}
+
+/**
+ * Returns the index after the number starting at `from`, or -1 if it does not
+ * follow the json grammar `-?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?`.
+ */
+Int c_json_number_end(const struct Pos arr, const Int from) {
+    Int result = c_json_scan_number(c_bytearray_data(arr), arr.tag, from);
+    erasePositive(arr);
+    return result;
+}
+
+/**
+ * Parses the number between `from` and `to`, as validated by `c_json_number_end`.
+ */
+Double c_json_number(const struct Pos arr, const Int from, const Int to) {
+    Double value = c_bytearray_parse_double(c_bytearray_data(arr) + from, to - from);
+    erasePositive(arr);
+    return value;
+}
+
+#endif
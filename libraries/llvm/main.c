@@ -15,6 +15,8 @@
 #include "panic.c"
 #include "ref.c"
 #include "array.c"
+#include "regex.c"
+#include "json.c"
 
 
 extern void effektMain();
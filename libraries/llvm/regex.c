@@ -0,0 +1,759 @@
+#ifndef EFFEKT_REGEX_C
+#define EFFEKT_REGEX_C
+
+/** Regular expressions are compiled to a program for a Pike VM, which runs
+ *  over the UTF-8 contents of strings without copying them. Like JavaScript,
+ *  we report the leftmost match and prefer earlier alternatives and greedy
+ *  repetitions. Positions are byte offsets, like all string indices on LLVM.
+ *
+ *  Supported are literals, `.`, classes `[a-z]` and `[^...]`, the escapes
+ *  `\d \w \s \D \W \S \b \B \n \r \t \f \v \0 \xHH \uHHHH`, anchors `^ $`,
+ *  groups `(...)` and `(?:...)`, alternatives `|`, and the greedy and lazy
+ *  quantifiers `* + ? {n} {n,} {n,m}`.
+ *
+ *  A regex is a positive type with tag 0 and obj pointing to:
+ *
+ *   +--[ Header ]--+---------+
+ *   | Rc  | Eraser | Program |
+ *   +--------------+---------+
+ *
+ *  A match is a positive type with the index as tag (-1 if there is none)
+ *  and obj pointing to:
+ *
+ *   +--[ Header ]--+---------+
+ *   | Rc  | Eraser | Matched |
+ *   +--------------+---------+
+ */
+
+enum RegexOp {
+  REGEX_CHAR,      // match the code point `argument`
+  REGEX_ANY,       // match any code point but '\n'
+  REGEX_CLASS,     // match a code point in class `argument`
+  REGEX_SPLIT,     // continue at `argument`, then at `alternative`
+  REGEX_JUMP,      // continue at `argument`
+  REGEX_LINE_START,
+  REGEX_LINE_END,
+  REGEX_WORD_BOUNDARY,
+  REGEX_NOT_WORD_BOUNDARY,
+  REGEX_MATCH,
+};
+
+struct RegexInstruction {
+  enum RegexOp op;
+  uint32_t argument;
+  uint32_t alternative;
+};
+
+struct RegexRange {
+  uint32_t low;
+  uint32_t high;
+};
+
+struct RegexClass {
+  bool negated;
+  uint32_t size;
+  uint32_t capacity;
+  struct RegexRange *ranges;
+};
+
+struct RegexProgram {
+  uint32_t size;
+  uint32_t capacity;
+  struct RegexInstruction *instructions;
+  uint32_t classes_size;
+  uint32_t classes_capacity;
+  struct RegexClass *classes;
+  // matches have to start with this byte, or -1 if unknown
+  int32_t first_byte;
+  bool anchored;
+};
+
+// Syntax tree
+// -----------
+
+enum RegexNodeKind {
+  REGEX_NODE_EMPTY,
+  REGEX_NODE_CHAR,
+  REGEX_NODE_ANY,
+  REGEX_NODE_CLASS,
+  REGEX_NODE_ASSERT,
+  REGEX_NODE_CONCAT,
+  REGEX_NODE_ALTERNATIVE,
+  REGEX_NODE_REPEAT,
+};
+
+// Repetitions without upper bound
+static const uint32_t c_regex_unbounded = UINT32_MAX;
+
+// Bounded repetitions are unrolled, so we limit their size
+static const uint32_t c_regex_max_repetitions = 1000;
+
+struct RegexNode {
+  enum RegexNodeKind kind;
+  uint32_t value;           // code point, class, or assertion op
+  uint32_t min, max;        // for repetitions
+  bool greedy;
+  struct RegexNode *left;   // also the body of repetitions
+  struct RegexNode *right;
+};
+
+struct RegexParser {
+  const uint8_t *pattern;
+  uint64_t size;
+  uint64_t position;
+  struct RegexProgram *program;
+};
+
+void c_regex_panic(const struct RegexParser *parser, const char *reason) {
+  printf("PANIC: Invalid regular expression /%.*s/: %s\n", (int)parser->size, (const char*)parser->pattern, reason);
+  exit(1);
+}
+
+struct RegexNode* c_regex_node(enum RegexNodeKind kind, uint32_t value, struct RegexNode *left, struct RegexNode *right) {
+  struct RegexNode *node = malloc(sizeof(struct RegexNode));
+  *node = (struct RegexNode) { .kind = kind, .value = value, .min = 0, .max = 0, .greedy = true, .left = left, .right = right };
+  return node;
+}
+
+void c_regex_free_node(struct RegexNode *node) {
+  if (node == NULL) return;
+  c_regex_free_node(node->left);
+  c_regex_free_node(node->right);
+  free(node);
+}
+
+// Decodes one code point, invalid UTF-8 is read byte by byte
+uint32_t c_regex_decode(const uint8_t *bytes, const uint64_t size, const uint64_t position, uint64_t *width) {
+  uint8_t first_byte = bytes[position];
+  uint64_t n;
+  uint32_t character;
+  if (first_byte < 0x80) { *width = 1; return first_byte; }
+  else if ((first_byte & 0xE0) == 0xC0) { n = 2; character = first_byte & 0x1F; }
+  else if ((first_byte & 0xF0) == 0xE0) { n = 3; character = first_byte & 0x0F; }
+  else if ((first_byte & 0xF8) == 0xF0) { n = 4; character = first_byte & 0x07; }
+  else { *width = 1; return first_byte; }
+
+  if (position + n > size) { *width = 1; return first_byte; }
+  for (uint64_t k = 1; k < n; k++) {
+    uint8_t byte = bytes[position + k];
+    if ((byte & 0xC0) != 0x80) { *width = 1; return first_byte; }
+    character = (character << 6) | (byte & 0x3F);
+  }
+  *width = n;
+  return character;
+}
+
+bool c_regex_at_end(const struct RegexParser *parser) {
+  return parser->position >= parser->size;
+}
+
+uint8_t c_regex_peek(const struct RegexParser *parser) {
+  return c_regex_at_end(parser) ? 0 : parser->pattern[parser->position];
+}
+
+uint32_t c_regex_next(struct RegexParser *parser) {
+  uint64_t width;
+  uint32_t character = c_regex_decode(parser->pattern, parser->size, parser->position, &width);
+  parser->position += width;
+  return character;
+}
+
+uint32_t c_regex_add_class(struct RegexProgram *program, bool negated) {
+  if (program->classes_size == program->classes_capacity) {
+    program->classes_capacity = program->classes_capacity * 2 + 4;
+    program->classes = realloc(program->classes, program->classes_capacity * sizeof(struct RegexClass));
+  }
+  program->classes[program->classes_size] = (struct RegexClass) { .negated = negated, .size = 0, .capacity = 0, .ranges = NULL };
+  return program->classes_size++;
+}
+
+void c_regex_add_range(struct RegexClass *class, uint32_t low, uint32_t high) {
+  if (class->size == class->capacity) {
+    class->capacity = class->capacity * 2 + 4;
+    class->ranges = realloc(class->ranges, class->capacity * sizeof(struct RegexRange));
+  }
+  class->ranges[class->size++] = (struct RegexRange) { low, high };
+}
+
+// Adds the ranges of \d, \w or \s, returns false for other letters
+bool c_regex_add_shorthand(struct RegexClass *class, uint32_t letter) {
+  switch (letter) {
+    case 'd':
+      c_regex_add_range(class, '0', '9');
+      return true;
+    case 'w':
+      c_regex_add_range(class, '0', '9');
+      c_regex_add_range(class, 'A', 'Z');
+      c_regex_add_range(class, '_', '_');
+      c_regex_add_range(class, 'a', 'z');
+      return true;
+    case 's':
+      c_regex_add_range(class, '\t', '\r');
+      c_regex_add_range(class, ' ', ' ');
+      c_regex_add_range(class, 0xA0, 0xA0);
+      c_regex_add_range(class, 0x2028, 0x2029);
+      c_regex_add_range(class, 0xFEFF, 0xFEFF);
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t c_regex_hex(struct RegexParser *parser, int digits) {
+  uint32_t value = 0;
+  for (int i = 0; i < digits; i++) {
+    uint8_t c = c_regex_peek(parser);
+    uint32_t digit = c_bytearray_digit_values[c];
+    if (c_regex_at_end(parser) || digit >= 16) c_regex_panic(parser, "invalid hexadecimal escape");
+    value = value * 16 + digit;
+    parser->position++;
+  }
+  return value;
+}
+
+// Parses the escaped character after a backslash
+uint32_t c_regex_escaped_character(struct RegexParser *parser) {
+  if (c_regex_at_end(parser)) c_regex_panic(parser, "trailing backslash");
+  uint32_t letter = c_regex_next(parser);
+  switch (letter) {
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case '0': return 0;
+    case 'x': return c_regex_hex(parser, 2);
+    case 'u': return c_regex_hex(parser, 4);
+    default:
+      if ((letter >= 'a' && letter <= 'z') || (letter >= 'A' && letter <= 'Z') || (letter >= '1' && letter <= '9')) {
+        c_regex_panic(parser, "unsupported escape");
+      }
+      return letter;
+  }
+}
+
+struct RegexNode* c_regex_parse_class(struct RegexParser *parser) {
+  bool negated = c_regex_peek(parser) == '^';
+  if (negated) parser->position++;
+  uint32_t index = c_regex_add_class(parser->program, negated);
+
+  bool first = true;
+  while (c_regex_peek(parser) != ']' || first) {
+    if (c_regex_at_end(parser)) c_regex_panic(parser, "unterminated character class");
+    first = false;
+
+    uint32_t low = c_regex_next(parser);
+    if (low == '\\') {
+      uint8_t letter = c_regex_peek(parser);
+      if (c_regex_add_shorthand(&parser->program->classes[index], letter)) {
+        parser->position++;
+        continue;
+      }
+      if (letter == 'D' || letter == 'W' || letter == 'S') c_regex_panic(parser, "negated shorthand in class");
+      low = letter == 'b' ? (parser->position++, '\b') : c_regex_escaped_character(parser);
+    }
+
+    uint32_t high = low;
+    if (c_regex_peek(parser) == '-' && parser->position + 1 < parser->size && parser->pattern[parser->position + 1] != ']') {
+      parser->position++;
+      high = c_regex_next(parser);
+      if (high == '\\') high = c_regex_escaped_character(parser);
+      if (high < low) c_regex_panic(parser, "range out of order in character class");
+    }
+    c_regex_add_range(&parser->program->classes[index], low, high);
+  }
+  parser->position++; // ]
+  return c_regex_node(REGEX_NODE_CLASS, index, NULL, NULL);
+}
+
+struct RegexNode* c_regex_parse_alternative(struct RegexParser *parser);
+
+struct RegexNode* c_regex_parse_atom(struct RegexParser *parser) {
+  uint32_t c = c_regex_next(parser);
+  switch (c) {
+    case '.':
+      return c_regex_node(REGEX_NODE_ANY, 0, NULL, NULL);
+    case '^':
+      return c_regex_node(REGEX_NODE_ASSERT, REGEX_LINE_START, NULL, NULL);
+    case '$':
+      return c_regex_node(REGEX_NODE_ASSERT, REGEX_LINE_END, NULL, NULL);
+    case '[':
+      return c_regex_parse_class(parser);
+    case '(': {
+      if (c_regex_peek(parser) == '?') {
+        if (parser->position + 1 < parser->size && parser->pattern[parser->position + 1] == ':') {
+          parser->position += 2;
+        } else {
+          c_regex_panic(parser, "unsupported group");
+        }
+      }
+      struct RegexNode *inner = c_regex_parse_alternative(parser);
+      if (c_regex_peek(parser) != ')') c_regex_panic(parser, "missing )");
+      parser->position++;
+      return inner;
+    }
+    case ')':
+      c_regex_panic(parser, "unmatched )");
+      return NULL;
+    case '*': case '+': case '?':
+      c_regex_panic(parser, "nothing to repeat");
+      return NULL;
+    case '\\': {
+      uint8_t letter = c_regex_peek(parser);
+      switch (letter) {
+        case 'b':
+          parser->position++;
+          return c_regex_node(REGEX_NODE_ASSERT, REGEX_WORD_BOUNDARY, NULL, NULL);
+        case 'B':
+          parser->position++;
+          return c_regex_node(REGEX_NODE_ASSERT, REGEX_NOT_WORD_BOUNDARY, NULL, NULL);
+        case 'd': case 'w': case 's': case 'D': case 'W': case 'S': {
+          parser->position++;
+          bool negated = letter == 'D' || letter == 'W' || letter == 'S';
+          uint32_t index = c_regex_add_class(parser->program, negated);
+          c_regex_add_shorthand(&parser->program->classes[index], letter | 0x20);
+          return c_regex_node(REGEX_NODE_CLASS, index, NULL, NULL);
+        }
+        default:
+          return c_regex_node(REGEX_NODE_CHAR, c_regex_escaped_character(parser), NULL, NULL);
+      }
+    }
+    default:
+      return c_regex_node(REGEX_NODE_CHAR, c, NULL, NULL);
+  }
+}
+
+// Parses `{n}`, `{n,}` or `{n,m}`, leaving the position unchanged if there is none
+bool c_regex_parse_bounds(struct RegexParser *parser, uint32_t *min, uint32_t *max) {
+  uint64_t start = parser->position;
+  if (c_regex_peek(parser) != '{') return false;
+  parser->position++;
+
+  uint64_t low = 0, high = 0;
+  uint64_t digits = 0;
+  while (c_bytearray_is_digit(c_regex_peek(parser)) && !c_regex_at_end(parser)) {
+    low = low * 10 + (c_regex_next(parser) - '0');
+    if (low > c_regex_max_repetitions) c_regex_panic(parser, "too many repetitions");
+    digits++;
+  }
+  high = low;
+  if (digits > 0 && c_regex_peek(parser) == ',') {
+    parser->position++;
+    if (c_regex_peek(parser) == '}') {
+      high = c_regex_unbounded;
+    } else {
+      high = 0;
+      uint64_t high_digits = 0;
+      while (c_bytearray_is_digit(c_regex_peek(parser)) && !c_regex_at_end(parser)) {
+        high = high * 10 + (c_regex_next(parser) - '0');
+        if (high > c_regex_max_repetitions) c_regex_panic(parser, "too many repetitions");
+        high_digits++;
+      }
+      if (high_digits == 0) digits = 0;
+    }
+  }
+  if (digits == 0 || c_regex_peek(parser) != '}') {
+    // not a quantifier, `{` is a literal then
+    parser->position = start;
+    return false;
+  }
+  parser->position++;
+  if (high < low) c_regex_panic(parser, "numbers out of order in quantifier");
+  *min = low;
+  *max = high;
+  return true;
+}
+
+struct RegexNode* c_regex_parse_repetition(struct RegexParser *parser) {
+  uint8_t first = c_regex_peek(parser);
+  struct RegexNode *atom;
+  if (first == '{') {
+    // a `{` that does not start a quantifier is a literal
+    parser->position++;
+    atom = c_regex_node(REGEX_NODE_CHAR, '{', NULL, NULL);
+  } else {
+    atom = c_regex_parse_atom(parser);
+  }
+
+  for (;;) {
+    uint32_t min, max;
+    switch (c_regex_peek(parser)) {
+      case '*': parser->position++; min = 0; max = c_regex_unbounded; break;
+      case '+': parser->position++; min = 1; max = c_regex_unbounded; break;
+      case '?': parser->position++; min = 0; max = 1; break;
+      case '{':
+        if (c_regex_parse_bounds(parser, &min, &max)) break;
+        return atom;
+      default:
+        return atom;
+    }
+    if (atom->kind == REGEX_NODE_ASSERT) c_regex_panic(parser, "nothing to repeat");
+    struct RegexNode *repeat = c_regex_node(REGEX_NODE_REPEAT, 0, atom, NULL);
+    repeat->min = min;
+    repeat->max = max;
+    if (c_regex_peek(parser) == '?') {
+      parser->position++;
+      repeat->greedy = false;
+    }
+    atom = repeat;
+  }
+}
+
+struct RegexNode* c_regex_parse_concatenation(struct RegexParser *parser) {
+  struct RegexNode *result = c_regex_node(REGEX_NODE_EMPTY, 0, NULL, NULL);
+  while (!c_regex_at_end(parser) && c_regex_peek(parser) != '|' && c_regex_peek(parser) != ')') {
+    struct RegexNode *next = c_regex_parse_repetition(parser);
+    result = c_regex_node(REGEX_NODE_CONCAT, 0, result, next);
+  }
+  return result;
+}
+
+struct RegexNode* c_regex_parse_alternative(struct RegexParser *parser) {
+  struct RegexNode *result = c_regex_parse_concatenation(parser);
+  while (c_regex_peek(parser) == '|' && !c_regex_at_end(parser)) {
+    parser->position++;
+    struct RegexNode *next = c_regex_parse_concatenation(parser);
+    result = c_regex_node(REGEX_NODE_ALTERNATIVE, 0, result, next);
+  }
+  return result;
+}
+
+// Code generation
+// ---------------
+
+uint32_t c_regex_emit(struct RegexProgram *program, enum RegexOp op, uint32_t argument, uint32_t alternative) {
+  if (program->size == program->capacity) {
+    program->capacity = program->capacity * 2 + 16;
+    program->instructions = realloc(program->instructions, program->capacity * sizeof(struct RegexInstruction));
+  }
+  program->instructions[program->size] = (struct RegexInstruction) { op, argument, alternative };
+  return program->size++;
+}
+
+void c_regex_compile_node(struct RegexProgram *program, const struct RegexNode *node);
+
+// Emits an optional `node`, returns the split instruction to patch with the exit
+uint32_t c_regex_compile_optional(struct RegexProgram *program, const struct RegexNode *node, bool greedy) {
+  uint32_t split = c_regex_emit(program, REGEX_SPLIT, 0, 0);
+  c_regex_compile_node(program, node);
+  if (greedy) {
+    program->instructions[split].argument = split + 1;
+  } else {
+    program->instructions[split].alternative = split + 1;
+  }
+  return split;
+}
+
+void c_regex_patch_exit(struct RegexProgram *program, uint32_t split, bool greedy, uint32_t exit) {
+  if (greedy) {
+    program->instructions[split].alternative = exit;
+  } else {
+    program->instructions[split].argument = exit;
+  }
+}
+
+void c_regex_compile_node(struct RegexProgram *program, const struct RegexNode *node) {
+  switch (node->kind) {
+    case REGEX_NODE_EMPTY:
+      break;
+    case REGEX_NODE_CHAR:
+      c_regex_emit(program, REGEX_CHAR, node->value, 0);
+      break;
+    case REGEX_NODE_ANY:
+      c_regex_emit(program, REGEX_ANY, 0, 0);
+      break;
+    case REGEX_NODE_CLASS:
+      c_regex_emit(program, REGEX_CLASS, node->value, 0);
+      break;
+    case REGEX_NODE_ASSERT:
+      c_regex_emit(program, (enum RegexOp)node->value, 0, 0);
+      break;
+    case REGEX_NODE_CONCAT:
+      c_regex_compile_node(program, node->left);
+      c_regex_compile_node(program, node->right);
+      break;
+    case REGEX_NODE_ALTERNATIVE: {
+      uint32_t split = c_regex_emit(program, REGEX_SPLIT, 0, 0);
+      program->instructions[split].argument = program->size;
+      c_regex_compile_node(program, node->left);
+      uint32_t jump = c_regex_emit(program, REGEX_JUMP, 0, 0);
+      program->instructions[split].alternative = program->size;
+      c_regex_compile_node(program, node->right);
+      program->instructions[jump].argument = program->size;
+      break;
+    }
+    case REGEX_NODE_REPEAT: {
+      for (uint32_t i = 0; i < node->min; i++) {
+        c_regex_compile_node(program, node->left);
+      }
+      if (node->max == c_regex_unbounded) {
+        uint32_t split = c_regex_compile_optional(program, node->left, node->greedy);
+        c_regex_emit(program, REGEX_JUMP, split, 0);
+        c_regex_patch_exit(program, split, node->greedy, program->size);
+      } else {
+        uint32_t optional = node->max - node->min;
+        uint32_t *splits = malloc(sizeof(uint32_t) * (optional + 1));
+        for (uint32_t i = 0; i < optional; i++) {
+          splits[i] = c_regex_compile_optional(program, node->left, node->greedy);
+        }
+        for (uint32_t i = 0; i < optional; i++) {
+          c_regex_patch_exit(program, splits[i], node->greedy, program->size);
+        }
+        free(splits);
+      }
+      break;
+    }
+  }
+}
+
+// The byte every match has to start with, or -1
+int32_t c_regex_first_byte(const struct RegexNode *node) {
+  switch (node->kind) {
+    case REGEX_NODE_CHAR:
+      return node->value < 0x80 ? (int32_t)node->value : -1;
+    case REGEX_NODE_CONCAT: {
+      // the left spine of concatenations starts with an empty node
+      int32_t left = c_regex_first_byte(node->left);
+      if (left >= 0) return left;
+      return node->left->kind == REGEX_NODE_EMPTY ? c_regex_first_byte(node->right) : -1;
+    }
+    case REGEX_NODE_REPEAT:
+      return node->min > 0 ? c_regex_first_byte(node->left) : -1;
+    default:
+      return -1;
+  }
+}
+
+bool c_regex_is_anchored(const struct RegexNode *node) {
+  switch (node->kind) {
+    case REGEX_NODE_ASSERT:
+      return node->value == REGEX_LINE_START;
+    case REGEX_NODE_CONCAT:
+      if (c_regex_is_anchored(node->left)) return true;
+      return node->left->kind == REGEX_NODE_EMPTY && c_regex_is_anchored(node->right);
+    default:
+      return false;
+  }
+}
+
+void c_regex_erase(void *envPtr) {
+  struct RegexProgram *program = *(struct RegexProgram**)envPtr;
+  for (uint32_t i = 0; i < program->classes_size; i++) {
+    free(program->classes[i].ranges);
+  }
+  free(program->classes);
+  free(program->instructions);
+  free(program);
+}
+
+struct Pos c_regex_compile(const struct Pos pattern) {
+  struct RegexProgram *program = calloc(1, sizeof(struct RegexProgram));
+  struct RegexParser parser = {
+    .pattern = c_bytearray_data(pattern),
+    .size = pattern.tag,
+    .position = 0,
+    .program = program,
+  };
+
+  struct RegexNode *root = c_regex_parse_alternative(&parser);
+  if (!c_regex_at_end(&parser)) c_regex_panic(&parser, "unmatched )");
+
+  c_regex_compile_node(program, root);
+  c_regex_emit(program, REGEX_MATCH, 0, 0);
+  program->first_byte = c_regex_first_byte(root);
+  program->anchored = c_regex_is_anchored(root);
+  c_regex_free_node(root);
+  erasePositive(pattern);
+
+  void *objPtr = malloc(sizeof(struct Header) + sizeof(struct RegexProgram*));
+  struct Header *headerPtr = objPtr;
+  *headerPtr = (struct Header) { .rc = 0, .eraser = c_regex_erase, };
+  *(struct RegexProgram**)(objPtr + sizeof(struct Header)) = program;
+  return (struct Pos) {
+    .tag = 0,
+    .obj = objPtr,
+  };
+}
+
+// Matching
+// --------
+
+struct RegexThreads {
+  uint32_t size;
+  uint32_t *pcs;
+  uint64_t *starts;
+};
+
+static inline bool c_regex_is_word(const uint8_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool c_regex_class_contains(const struct RegexClass *class, const uint32_t character) {
+  bool found = false;
+  for (uint32_t i = 0; i < class->size && !found; i++) {
+    found = class->ranges[i].low <= character && character <= class->ranges[i].high;
+  }
+  return found != class->negated;
+}
+
+// Adds the thread at `pc` and follows jumps, splits and assertions in priority order
+void c_regex_add_thread(const struct RegexProgram *program, struct RegexThreads *threads, uint64_t *visited, uint64_t generation,
+                        uint32_t pc, uint64_t start, const uint8_t *bytes, uint64_t size, uint64_t position) {
+  if (visited[pc] == generation) return;
+  visited[pc] = generation;
+
+  const struct RegexInstruction *instruction = &program->instructions[pc];
+  switch (instruction->op) {
+    case REGEX_JUMP:
+      c_regex_add_thread(program, threads, visited, generation, instruction->argument, start, bytes, size, position);
+      return;
+    case REGEX_SPLIT:
+      c_regex_add_thread(program, threads, visited, generation, instruction->argument, start, bytes, size, position);
+      c_regex_add_thread(program, threads, visited, generation, instruction->alternative, start, bytes, size, position);
+      return;
+    case REGEX_LINE_START:
+      if (position == 0) c_regex_add_thread(program, threads, visited, generation, pc + 1, start, bytes, size, position);
+      return;
+    case REGEX_LINE_END:
+      if (position == size) c_regex_add_thread(program, threads, visited, generation, pc + 1, start, bytes, size, position);
+      return;
+    case REGEX_WORD_BOUNDARY:
+    case REGEX_NOT_WORD_BOUNDARY: {
+      bool before = position > 0 && c_regex_is_word(bytes[position - 1]);
+      bool after = position < size && c_regex_is_word(bytes[position]);
+      if ((before != after) == (instruction->op == REGEX_WORD_BOUNDARY)) {
+        c_regex_add_thread(program, threads, visited, generation, pc + 1, start, bytes, size, position);
+      }
+      return;
+    }
+    default:
+      threads->pcs[threads->size] = pc;
+      threads->starts[threads->size] = start;
+      threads->size++;
+      return;
+  }
+}
+
+// Finds the leftmost match, returns false if there is none
+bool c_regex_search(const struct RegexProgram *program, const uint8_t *bytes, const uint64_t size, uint64_t *match_start, uint64_t *match_end) {
+  uint32_t n = program->size;
+  uint32_t *pcs = malloc(sizeof(uint32_t) * 2 * n);
+  uint64_t *starts = malloc(sizeof(uint64_t) * 2 * n);
+  uint64_t *visited = calloc(n, sizeof(uint64_t));
+  struct RegexThreads current = { 0, pcs, starts };
+  struct RegexThreads next = { 0, pcs + n, starts + n };
+  // threads are deduplicated per position, the start thread shares the
+  // generation of the threads that stepped to the same position
+  uint64_t generation = 1;
+  bool matched = false;
+
+  uint64_t position = 0;
+  for (;;) {
+    if (!matched && current.size == 0) {
+      if (program->anchored && position > 0) break;
+      if (program->first_byte >= 0) {
+        const uint8_t *candidate = position < size ? memchr(bytes + position, program->first_byte, size - position) : NULL;
+        if (candidate == NULL) break;
+        position = candidate - bytes;
+      }
+      generation++;
+    }
+
+    if (!matched) {
+      // new threads have the lowest priority
+      c_regex_add_thread(program, &current, visited, generation, 0, position, bytes, size, position);
+    }
+    if (matched && current.size == 0) break;
+
+    uint64_t width = 1;
+    uint32_t character = position < size ? c_regex_decode(bytes, size, position, &width) : 0;
+    generation++;
+    next.size = 0;
+
+    for (uint32_t i = 0; i < current.size; i++) {
+      const struct RegexInstruction *instruction = &program->instructions[current.pcs[i]];
+      bool step = false;
+      switch (instruction->op) {
+        case REGEX_CHAR:
+          step = position < size && character == instruction->argument;
+          break;
+        case REGEX_ANY:
+          step = position < size && character != '\n';
+          break;
+        case REGEX_CLASS:
+          step = position < size && c_regex_class_contains(&program->classes[instruction->argument], character);
+          break;
+        case REGEX_MATCH:
+          matched = true;
+          *match_start = current.starts[i];
+          *match_end = position;
+          // threads of lower priority are cut off
+          i = current.size;
+          break;
+        default:
+          break;
+      }
+      if (step) {
+        c_regex_add_thread(program, &next, visited, generation, current.pcs[i] + 1, current.starts[i], bytes, size, position + width);
+      }
+    }
+
+    struct RegexThreads swap = current;
+    current = next;
+    next = swap;
+    if (position >= size) break;
+    position += width;
+  }
+
+  free(pcs);
+  free(starts);
+  free(visited);
+  return matched;
+}
+
+void c_regex_erase_match(void *envPtr) {
+  struct Pos *matchedPtr = envPtr;
+  erasePositive(*matchedPtr);
+}
+
+struct Pos c_regex_exec(const struct Pos regex, const struct Pos str) {
+  const struct RegexProgram *program = *(struct RegexProgram**)(regex.obj + sizeof(struct Header));
+  uint64_t start, end;
+  bool found = c_regex_search(program, c_bytearray_data(str), str.tag, &start, &end);
+  erasePositive(regex);
+
+  if (!found) {
+    erasePositive(str);
+    return (struct Pos) { .tag = (uint64_t)-1, .obj = NULL, };
+  }
+
+  void *objPtr = malloc(sizeof(struct Header) + sizeof(struct Pos));
+  struct Header *headerPtr = objPtr;
+  *headerPtr = (struct Header) { .rc = 0, .eraser = c_regex_erase_match, };
+  *(struct Pos*)(objPtr + sizeof(struct Header)) = c_bytearray_substring(str, start, end);
+  return (struct Pos) {
+    .tag = start,
+    .obj = objPtr,
+  };
+}
+
+struct Pos c_regex_match_found(const struct Pos match) {
+  bool found = match.obj != NULL;
+  erasePositive(match);
+  return found ? BooleanTrue : BooleanFalse;
+}
+
+Int c_regex_match_index(const struct Pos match) {
+  Int index = match.tag;
+  erasePositive(match);
+  return index;
+}
+
+struct Pos c_regex_match_matched(const struct Pos match) {
+  struct Pos matched = *(struct Pos*)(match.obj + sizeof(struct Header));
+  sharePositive(matched);
+  erasePositive(match);
+  return matched;
+}
+
+#endif
@@ -9,6 +9,9 @@
 ; Reference counts
 %ReferenceCount = type i64
 
+; Statically allocated objects, like string literals, are immortal:
+; their reference count is -1, which sharing and erasing leave alone.
+
 ; Code to share (bump rc) an environment
 %Sharer = type ptr
 
@@ -181,6 +184,10 @@ define private void @shareObject(%Object %object) alwaysinline {
     next:
     %objectReferenceCount = getelementptr %Header, ptr %object, i64 0, i32 0
     %referenceCount = load %ReferenceCount, ptr %objectReferenceCount, !alias.scope !14, !noalias !24
+    %isImmortal = icmp eq %ReferenceCount %referenceCount, -1
+    br i1 %isImmortal, label %done, label %incr
+
+    incr:
     %referenceCount.1 = add %ReferenceCount %referenceCount, 1
     store %ReferenceCount %referenceCount.1, ptr %objectReferenceCount, !alias.scope !14, !noalias !24
     br label %done
@@ -208,7 +215,8 @@ define private void @eraseObject(%Object %object) alwaysinline {
     next:
     %objectReferenceCount = getelementptr %Header, ptr %object, i64 0, i32 0
     %referenceCount = load %ReferenceCount, ptr %objectReferenceCount, !alias.scope !14, !noalias !24
-    switch %ReferenceCount %referenceCount, label %decr [%ReferenceCount 0, label %free]
+    switch %ReferenceCount %referenceCount, label %decr [%ReferenceCount 0, label %free
+                                                        %ReferenceCount -1, label %done]
 
     decr:
     %referenceCount.1 = sub %ReferenceCount %referenceCount, 1
@@ -257,6 +265,13 @@ define private ptr @getVarPointer(%Reference %reference, %Stack %stack) {
     ret ptr %varPointer
 }
 
+; Only valid if the prompt of the reference is the one of %stack
+define private ptr @getLocalVarPointer(%Reference %reference, %Stack %stack) alwaysinline {
+    %offset = extractvalue %Reference %reference, 1
+    %varPointer = getelementptr i8, %Base %stack, i64 %offset
+    ret ptr %varPointer
+}
+
 define private %Reference @newReference(%Stack %stack) alwaysinline {
     %stackPointer_pointer = getelementptr %StackValue, %Stack %stack, i64 0, i32 1
     %stackPointer = load %StackPointer, ptr %stackPointer_pointer, !alias.scope !11, !noalias !21